@@ -3,8 +3,9 @@ var socket;
 window.addEventListener("load", on_load);
 
 var last_timestamp = Number.MIN_SAFE_INTEGER;
-var target_temperature = 10;
-var should_apply_changes = false;
+var zones = {};
+var next_seq = 1;
+var pending_commands = {};
 
 function init_socket() {
   socket = new WebSocket(gateway);
@@ -26,59 +27,130 @@ function on_ws_message(event) {
   try {
     const data = JSON.parse(event.data);
 
-    if (data.hasOwnProperty("current_temperature")) {
-      const element = document.getElementById("current-temperature");
-      element.textContent = data.current_temperature.toFixed(1) + "°C";
+    if (data.hasOwnProperty("ack") || data.hasOwnProperty("nack")) {
+      on_command_response(data);
     }
-    if (data.hasOwnProperty("target_temperature")) {
-      const element = document.getElementById("target-temperature");
-      target_temperature = data.target_temperature;
-      if (document.activeElement !== element) {
-        element.value = target_temperature.toFixed(1);
-      }
-    }
-    if(data.hasOwnProperty("heater_state")){
-      const element = document.getElementById("heater-state");
-      element.checked = data.heater_state;
+    if (data.hasOwnProperty("zones")) {
+      data.zones.forEach(on_zone_update);
     }
   } catch (error) {
     console.error("Error parsing JSON:", error);
   }
 }
 
+function on_zone_update(data) {
+  const zone = get_zone(data.zone);
+
+  if (data.hasOwnProperty("current_temperature")) {
+    const element = zone.element.querySelector(".current-temperature");
+    element.textContent = data.current_temperature.toFixed(1) + "°C";
+  }
+  if (data.hasOwnProperty("target_temperature")) {
+    const element = zone.element.querySelector(".target-temperature");
+    zone.target_temperature = data.target_temperature;
+    if (document.activeElement !== element) {
+      element.value = zone.target_temperature.toFixed(1);
+    }
+  }
+  if (data.hasOwnProperty("heater_state")) {
+    const element = zone.element.querySelector(".heater-state");
+    element.checked = data.heater_state;
+  }
+  if (data.hasOwnProperty("fault")) {
+    const element = zone.element.querySelector(".fault");
+    element.hidden = data.fault === "none";
+    element.textContent = "fault: " + data.fault.replaceAll("_", " ");
+  }
+}
+
+// zones are created the first time the device mentions them
+function get_zone(id) {
+  if (zones.hasOwnProperty(id)) {
+    return zones[id];
+  }
+
+  const template = document.getElementById("zone-template");
+  const element = template.content.firstElementChild.cloneNode(true);
+  const zone = {
+    id: id,
+    element: element,
+    target_temperature: null,
+    should_apply_changes: false,
+  };
+  zones[id] = zone;
+
+  element.querySelector(".zone-name").textContent = "zone " + id;
+  init_zone_controls(zone);
+
+  // keep the zones ordered by id
+  const container = document.getElementById("zones");
+  const next = Object.values(zones)
+    .filter((other) => other.id > id)
+    .sort((a, b) => a.id - b.id)[0];
+  container.insertBefore(element, next ? next.element : null);
+
+  // names only matter once there is more than one zone
+  const count = Object.keys(zones).length;
+  for (const other of Object.values(zones)) {
+    other.element.querySelector(".zone-name").hidden = count === 1;
+  }
+
+  return zone;
+}
+
 function on_ws_error(event) {}
 
+function send_command(ops) {
+  const seq = next_seq++;
+  pending_commands[seq] = performance.now();
+
+  const json_string = JSON.stringify({ seq: seq, ops: ops });
+  console.log(json_string);
+  socket.send(json_string);
+}
+
+function on_command_response(data) {
+  const seq = data.hasOwnProperty("ack") ? data.ack : data.nack;
+  if (pending_commands.hasOwnProperty(seq)) {
+    const latency = performance.now() - pending_commands[seq];
+    delete pending_commands[seq];
+    console.log(`command ${seq} answered in ${latency.toFixed(1)} ms`);
+  }
+  if (data.hasOwnProperty("nack")) {
+    console.error(`command ${seq} rejected: ${data.error}`);
+  }
+}
+
 function on_load(event) {
   init_socket();
+}
 
+function init_zone_controls(zone) {
   // on/off switch
-  document
-    .getElementById("heater-state")
-    .addEventListener("click", on_checkbox_click);
+  zone.element
+    .querySelector(".heater-state")
+    .addEventListener("click", (event) => on_checkbox_click(zone, event));
 
   // target temperature
-  const target_temperature = document.getElementById("target-temperature");
+  const target_temperature = zone.element.querySelector(".target-temperature");
   target_temperature.addEventListener("input", on_target_temperature_input);
   target_temperature.addEventListener("keypress", (event) => {
     if (event.key === "Enter") {
-      should_apply_changes = true;
+      zone.should_apply_changes = true;
       event.target.blur();
-      on_target_temperature_confirm(event.target.value);
+      on_target_temperature_confirm(zone, event.target.value);
     }
   });
-  target_temperature.addEventListener("blur", on_target_temperature_blur);
+  target_temperature.addEventListener("blur", (event) =>
+    on_target_temperature_blur(zone, event.target)
+  );
 }
 
-function on_checkbox_click(event) {
+function on_checkbox_click(zone, event) {
+  // the checkbox follows the state in the device response
   event.preventDefault();
 
-  const data = {
-    heater_state: this.checked,
-  };
-
-  const json_string = JSON.stringify(data);
-  console.log(json_string)
-  socket.send(json_string);
+  send_command([{ zone: zone.id, heater_state: event.target.checked }]);
 }
 
 function on_target_temperature_input() {
@@ -105,25 +177,20 @@ function on_target_temperature_input() {
   this.value = value;
 }
 
-function on_target_temperature_confirm(value) {
+function on_target_temperature_confirm(zone, value) {
   let float_value = parseFloat(value);
 
-  const data = {
-    target_temperature: float_value,
-  };
-
-  const json_string = JSON.stringify(data);
-  socket.send(json_string);
+  send_command([{ zone: zone.id, target_temperature: float_value }]);
 }
 
-function on_target_temperature_blur() {
-  if (should_apply_changes) {
-    should_apply_changes = false;
+function on_target_temperature_blur(zone, element) {
+  if (zone.should_apply_changes) {
+    zone.should_apply_changes = false;
   } else {
-    if (target_temperature == null) {
-      this.value = "";
+    if (zone.target_temperature == null) {
+      element.value = "";
     } else {
-      this.value = target_temperature.toFixed(1);
+      element.value = zone.target_temperature.toFixed(1);
     }
   }
 }
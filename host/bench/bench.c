@@ -0,0 +1,362 @@
+#include "fake_httpd.h"
+
+#include <heater.h>
+#include <host_stubs.h>
+#include <temperature.h>
+#include <web_site.h>
+
+#include <esp_log.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// micro-benchmarks for the firmware hot paths, linked against the real main/ sources
+// every case is measured --repetitions times and the median of each metric is reported
+//
+// usage: bench [--filter <substring>] [--min-time-ms <ms>] [--repetitions <n>] [--json <path>]
+//              [--label <name>]
+
+#define DEFAULT_MIN_TIME_MS 200
+#define DEFAULT_REPETITIONS 5
+#define MAX_REPETITIONS 31
+#define BROADCAST_CLIENTS 8
+
+struct {
+    const char *name;
+    void (*setup)();
+    void (*op)(uint64_t p_i);
+} typedef bench_case_t;
+
+struct {
+    const char *name;
+    uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;
+    double frames_per_op;
+} typedef bench_result_t;
+
+// counted through -Wl,--wrap so every allocation in the firmware and cJSON is seen
+
+static atomic_uint_fast64_t alloc_count = 0;
+static atomic_uint_fast64_t alloc_bytes = 0;
+
+void *__real_malloc(size_t p_size);
+void *__real_calloc(size_t p_count, size_t p_size);
+void *__real_realloc(void *p_ptr, size_t p_size);
+
+void *__wrap_malloc(size_t p_size) {
+    alloc_count++;
+    alloc_bytes += p_size;
+    return __real_malloc(p_size);
+}
+
+void *__wrap_calloc(size_t p_count, size_t p_size) {
+    alloc_count++;
+    alloc_bytes += p_count * p_size;
+    return __real_calloc(p_count, p_size);
+}
+
+void *__wrap_realloc(void *p_ptr, size_t p_size) {
+    alloc_count++;
+    alloc_bytes += p_size;
+    return __real_realloc(p_ptr, p_size);
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void reset_configuration(int p_zones) {
+    xSemaphoreTake(configuration_mutex, portMAX_DELAY);
+    zones_count = p_zones;
+    for (int zone = 0; zone < MAX_ZONES; zone++) {
+        heaters[zone].target_temperature = 60;
+        heaters[zone].heater_state = true;
+        current_temperature[zone] = 57.5f;
+    }
+    xSemaphoreGive(configuration_mutex);
+}
+
+static void setup_no_clients() {
+    reset_configuration(1);
+    fake_httpd_set_clients(0);
+}
+
+static void setup_broadcast_clients() {
+    reset_configuration(1);
+    fake_httpd_set_clients(BROADCAST_CLIENTS);
+}
+
+static void setup_all_zones_no_clients() {
+    reset_configuration(MAX_ZONES);
+    fake_httpd_set_clients(0);
+}
+
+static void setup_all_zones_broadcast_clients() {
+    reset_configuration(MAX_ZONES);
+    fake_httpd_set_clients(BROADCAST_CLIENTS);
+}
+
+static void op_encode_temperature(uint64_t p_i) {
+    for (int zone = 0; zone < zones_count; zone++) {
+        current_temperature[zone] = 20.f + ((p_i + zone) % 700) * 0.1f;
+    }
+    send_temperature_update(NULL, FD_EVERYONE);
+}
+
+static void op_encode_state(uint64_t p_i) {
+    xSemaphoreTake(configuration_mutex, portMAX_DELAY);
+    send_state_update(NULL, FD_EVERYONE);
+    xSemaphoreGive(configuration_mutex);
+}
+
+static void run_command(const char *p_text) {
+    char *response = NULL;
+    apply_command(p_text, &response);
+    free(response);
+}
+
+static void op_command_legacy(uint64_t p_i) {
+    run_command("{\"target_temperature\": 60}");
+}
+
+static void op_command_envelope(uint64_t p_i) {
+    run_command("{\"seq\": 1, \"ops\": [{\"target_temperature\": 60}, {\"heater_state\": true}]}");
+}
+
+// every op changes the setpoint, so it also pays for the broadcast and the nvs save
+static void op_command_envelope_changed(uint64_t p_i) {
+    run_command(p_i % 2 ? "{\"seq\": 1, \"ops\": [{\"target_temperature\": 60}]}"
+                        : "{\"seq\": 2, \"ops\": [{\"target_temperature\": 61}]}");
+}
+
+// one setpoint per zone in one envelope, still one broadcast
+static void op_command_all_zones_changed(uint64_t p_i) {
+    run_command(p_i % 2 ? "{\"seq\": 1, \"ops\": [{\"zone\": 0, \"target_temperature\": 60}, "
+                          "{\"zone\": 1, \"target_temperature\": 60}, "
+                          "{\"zone\": 2, \"target_temperature\": 60}, "
+                          "{\"zone\": 3, \"target_temperature\": 60}]}"
+                        : "{\"seq\": 2, \"ops\": [{\"zone\": 0, \"target_temperature\": 61}, "
+                          "{\"zone\": 1, \"target_temperature\": 61}, "
+                          "{\"zone\": 2, \"target_temperature\": 61}, "
+                          "{\"zone\": 3, \"target_temperature\": 61}]}");
+}
+
+static void op_command_rejected(uint64_t p_i) {
+    run_command("{\"seq\": 1, \"ops\": [{\"target_temperature\": 60}, {\"heater_state\": 1}]}");
+}
+
+static void op_controller_step(uint64_t p_i) {
+    for (int zone = 0; zone < zones_count; zone++) {
+        current_temperature[zone] = 55.f + (p_i % 100) * 0.1f;
+        heater_on_temperature_update(zone);
+    }
+}
+
+static const bench_case_t bench_cases[] = {
+    {"encode_temperature", setup_no_clients, op_encode_temperature},
+    {"encode_state", setup_no_clients, op_encode_state},
+    {"broadcast_temperature_8", setup_broadcast_clients, op_encode_temperature},
+    {"command_legacy_unchanged", setup_no_clients, op_command_legacy},
+    {"command_envelope_unchanged", setup_no_clients, op_command_envelope},
+    {"command_envelope_changed_8", setup_broadcast_clients, op_command_envelope_changed},
+    {"command_rejected", setup_no_clients, op_command_rejected},
+    {"controller_step", setup_no_clients, op_controller_step},
+    {"encode_temperature_4_zones", setup_all_zones_no_clients, op_encode_temperature},
+    {"command_4_zones_changed_8", setup_all_zones_broadcast_clients, op_command_all_zones_changed},
+    {"controller_step_4_zones", setup_all_zones_no_clients, op_controller_step},
+};
+
+static int compare_double(const void *p_a, const void *p_b) {
+    double a = *(const double *)p_a;
+    double b = *(const double *)p_b;
+    return (a > b) - (a < b);
+}
+
+static double median(double *p_values, int p_count) {
+    qsort(p_values, p_count, sizeof(double), compare_double);
+    return p_values[p_count / 2];
+}
+
+// warm up and find an iteration count that runs for at least p_min_time_ns
+static uint64_t calibrate_case(const bench_case_t *p_case, uint64_t p_min_time_ns) {
+    p_case->setup();
+
+    uint64_t iterations = 1;
+    uint64_t elapsed = 0;
+    while (true) {
+        uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; i++) {
+            p_case->op(i);
+        }
+        elapsed = now_ns() - start;
+
+        if (elapsed >= p_min_time_ns / 10 || iterations >= (1ULL << 40)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    return iterations * p_min_time_ns / (elapsed ? elapsed : 1) + 1;
+}
+
+static bench_result_t measure_case(const bench_case_t *p_case, uint64_t p_iterations) {
+    p_case->setup();
+
+    uint64_t allocs_before = alloc_count;
+    uint64_t bytes_before = alloc_bytes;
+    uint64_t frames_before = fake_httpd_frames_sent();
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < p_iterations; i++) {
+        p_case->op(i);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    return (bench_result_t){
+        .name = p_case->name,
+        .iterations = p_iterations,
+        .ns_per_op = (double)elapsed / p_iterations,
+        .allocs_per_op = (double)(alloc_count - allocs_before) / p_iterations,
+        .bytes_per_op = (double)(alloc_bytes - bytes_before) / p_iterations,
+        .frames_per_op = (double)(fake_httpd_frames_sent() - frames_before) / p_iterations,
+    };
+}
+
+// the median of every metric on its own
+static bench_result_t median_result(const bench_result_t *p_samples, int p_count) {
+    double ns[MAX_REPETITIONS];
+    double allocs[MAX_REPETITIONS];
+    double bytes[MAX_REPETITIONS];
+    double frames[MAX_REPETITIONS];
+    for (int i = 0; i < p_count; i++) {
+        ns[i] = p_samples[i].ns_per_op;
+        allocs[i] = p_samples[i].allocs_per_op;
+        bytes[i] = p_samples[i].bytes_per_op;
+        frames[i] = p_samples[i].frames_per_op;
+    }
+
+    bench_result_t result = p_samples[0];
+    result.ns_per_op = median(ns, p_count);
+    result.allocs_per_op = median(allocs, p_count);
+    result.bytes_per_op = median(bytes, p_count);
+    result.frames_per_op = median(frames, p_count);
+    return result;
+}
+
+static void write_json(const char *p_path,
+                       const char *p_label,
+                       const bench_result_t *p_results,
+                       int p_count) {
+    FILE *fp = fopen(p_path, "w");
+    if (!fp) {
+        fprintf(stderr, "failed to open %s\n", p_path);
+        exit(1);
+    }
+
+    fprintf(fp, "{\n  \"label\": \"%s\",\n  \"results\": [\n", p_label);
+    for (int i = 0; i < p_count; i++) {
+        fprintf(fp,
+                "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, "
+                "\"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f, \"frames_per_op\": %.3f}%s\n",
+                p_results[i].name,
+                (unsigned long long)p_results[i].iterations,
+                p_results[i].ns_per_op,
+                p_results[i].allocs_per_op,
+                p_results[i].bytes_per_op,
+                p_results[i].frames_per_op,
+                i + 1 < p_count ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    fclose(fp);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL;
+    const char *json_path = NULL;
+    const char *label = "";
+    uint64_t min_time_ms = DEFAULT_MIN_TIME_MS;
+    int repetitions = DEFAULT_REPETITIONS;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (!strcmp(argv[i], "--label") && i + 1 < argc) {
+            label = argv[++i];
+        } else if (!strcmp(argv[i], "--min-time-ms") && i + 1 < argc) {
+            min_time_ms = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc) {
+            repetitions = atoi(argv[++i]);
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--filter <substring>] [--min-time-ms <ms>] [--repetitions <n>] "
+                    "[--json <path>] [--label <name>]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS) {
+        fprintf(stderr, "--repetitions must be within 1..%d\n", MAX_REPETITIONS);
+        return 1;
+    }
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+
+    zone_config_t zones[MAX_ZONES];
+    for (int zone = 0; zone < MAX_ZONES; zone++) {
+        zones[zone] = (zone_config_t){.heater_pin = 14 + zone};
+    }
+
+    init_heaters(zones, MAX_ZONES);
+    setup_web_server();
+
+    // the nvs commit task commits on the calling thread, so its cost is the same every run
+    host_freertos_set_inline_tasks(true);
+
+    const int cases_count = sizeof(bench_cases) / sizeof(*bench_cases);
+    const bench_case_t *selected[sizeof(bench_cases) / sizeof(*bench_cases)];
+    uint64_t iterations[sizeof(bench_cases) / sizeof(*bench_cases)];
+    int results_count = 0;
+    for (int i = 0; i < cases_count; i++) {
+        if (!filter || strstr(bench_cases[i].name, filter)) {
+            selected[results_count] = &bench_cases[i];
+            iterations[results_count++] = calibrate_case(&bench_cases[i], min_time_ms * 1000000);
+        }
+    }
+
+    // repetitions go round every case, so a slow phase of the host hits each case once
+    // instead of every repetition of one case
+    static bench_result_t samples[sizeof(bench_cases) / sizeof(*bench_cases)][MAX_REPETITIONS];
+    for (int repetition = 0; repetition < repetitions; repetition++) {
+        for (int i = 0; i < results_count; i++) {
+            samples[i][repetition] = measure_case(selected[i], iterations[i]);
+        }
+    }
+
+    bench_result_t results[sizeof(bench_cases) / sizeof(*bench_cases)];
+    printf("%-30s %12s %12s %12s %12s\n", "name", "ns/op", "allocs/op", "bytes/op", "frames/op");
+    for (int i = 0; i < results_count; i++) {
+        results[i] = median_result(samples[i], repetitions);
+        printf("%-30s %12.1f %12.2f %12.1f %12.2f\n",
+               results[i].name,
+               results[i].ns_per_op,
+               results[i].allocs_per_op,
+               results[i].bytes_per_op,
+               results[i].frames_per_op);
+    }
+
+    if (json_path) {
+        write_json(json_path, label, results, results_count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Compare two bench --json results and fail when a benchmark regressed.
+
+usage: compare.py <base.json> <new.json> [--threshold <percent>]
+"""
+
+import argparse
+import json
+import sys
+
+METRICS = ["ns_per_op", "allocs_per_op", "bytes_per_op", "frames_per_op"]
+COUNT_DIGITS = 2
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    return data.get("label", path), {r["name"]: r for r in data["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed ns/op slowdown in percent")
+    args = parser.parse_args()
+
+    base_label, base = load(args.base)
+    new_label, new = load(args.new)
+    print(f"{base_label or args.base} -> {new_label or args.new}")
+
+    regressed = False
+    for name, result in new.items():
+        if name not in base:
+            print(f"{name:30} new")
+            continue
+
+        changes = []
+        for metric in METRICS:
+            before, after = base[name][metric], result[metric]
+            # counts are averaged over the iterations, only whole changes per 100 ops count
+            if metric != "ns_per_op":
+                before, after = round(before, COUNT_DIGITS), round(after, COUNT_DIGITS)
+            if before == after:
+                continue
+            delta = (after - before) / before * 100 if before else float("inf")
+            changes.append(f"{metric} {before:g} -> {after:g} ({delta:+.1f}%)")
+
+            # time is noisy, rounded allocations and frames are exact
+            limit = args.threshold if metric == "ns_per_op" else 0
+            if delta > limit:
+                regressed = True
+                changes[-1] += " REGRESSION"
+
+        print(f"{name:30} {'; '.join(changes) if changes else 'unchanged'}")
+
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
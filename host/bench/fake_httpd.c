@@ -0,0 +1,83 @@
+#include "fake_httpd.h"
+
+#include <esp_http_server.h>
+
+#define FIRST_CLIENT_FD 100
+#define MAX_CLIENTS 64
+
+static int server;
+static int clients_count = 0;
+static uint64_t frames_sent = 0;
+static uint64_t bytes_sent = 0;
+
+void fake_httpd_set_clients(int p_count) {
+    clients_count = p_count < MAX_CLIENTS ? p_count : MAX_CLIENTS;
+}
+
+uint64_t fake_httpd_frames_sent() {
+    return frames_sent;
+}
+
+uint64_t fake_httpd_bytes_sent() {
+    return bytes_sent;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    *handle = &server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    work(arg);
+    return ESP_OK;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds) {
+    size_t count = (size_t)clients_count < *fds ? (size_t)clients_count : *fds;
+    for (size_t i = 0; i < count; i++) {
+        client_fds[i] = FIRST_CLIENT_FD + i;
+    }
+
+    *fds = count;
+    return ESP_OK;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+    return fd >= FIRST_CLIENT_FD && fd < FIRST_CLIENT_FD + clients_count
+               ? HTTPD_WS_CLIENT_WEBSOCKET
+               : HTTPD_WS_CLIENT_INVALID;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+    frames_sent++;
+    bytes_sent += frame->len;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    return FIRST_CLIENT_FD;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    return ESP_OK;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// in-process httpd for the benchmarks, queued work runs inline and frames are only counted
+
+void fake_httpd_set_clients(int p_count);
+uint64_t fake_httpd_frames_sent();
+uint64_t fake_httpd_bytes_sent();
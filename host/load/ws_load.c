@@ -0,0 +1,729 @@
+#include "sim_httpd.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// websocket load generator for the firmware web server
+//
+// opens N /ws clients that send a mix of commands and measures
+// - command to ack latency at the sender
+// - command to target_temperature broadcast latency at every client
+// - acks and broadcasts that never arrived
+// - resident memory growth of the server, when it is started with --sim
+//
+// a client the server closes without a handshake response is counted as refused, the device
+// only has so many sockets, any handshake response other than 101 is an error
+//
+// every setpoint is unique so each broadcast can be traced back to the command that caused it,
+// commands are spread evenly over --zones zones
+//
+// usage: ws_load [--host <ip>] [--port <port>] [--clients <n>] [--rate <commands/s/client>]
+//                [--duration <s>] [--zones <n>] [--sim <path to sim>] [--json <path>]
+//                [--label <name>]
+
+#define DEFAULT_PORT 8080
+#define RECV_BUFFER_SIZE 8192
+#define SLOT_COUNT 7000 // setpoints 20.00..89.99 in 0.01 steps
+#define SETPOINT_BASE 20.f
+#define DRAIN_MS 2000
+#define SIM_START_TIMEOUT_MS 5000
+#define MAX_ZONES 8
+
+typedef enum {
+    CONNECT_OK,
+    CONNECT_REFUSED,  // connection failed or closed before a response, no free socket
+    CONNECT_REJECTED,  // the handshake was answered with something other than 101
+} connect_result_t;
+
+typedef enum {
+    COMMAND_SETPOINT,
+    COMMAND_POWER,
+    COMMAND_REJECTED,
+} command_kind_t;
+
+struct {
+    int fd;
+    bool open;
+    uint8_t buf[RECV_BUFFER_SIZE];
+    size_t len;
+    uint64_t next_send_ns;
+    // last broadcast slot seen per zone, a power change repeats the setpoint of its zone
+    int last_target[MAX_ZONES];
+} typedef client_t;
+
+struct {
+    bool in_use;
+    uint64_t sent_ns;
+    int expected; // clients connected when the command was sent
+    int received;
+} typedef setpoint_slot_t;
+
+struct {
+    bool in_use;
+    uint64_t sent_ns;
+    command_kind_t kind;
+} typedef ack_slot_t;
+
+struct {
+    uint32_t *values;
+    size_t count;
+    size_t capacity;
+} typedef latencies_t;
+
+struct {
+    uint64_t commands_sent[3];
+    uint64_t acks;
+    uint64_t nacks;
+    uint64_t unexpected_nacks;
+    uint64_t broadcasts;
+    uint64_t broadcasts_dropped;
+    uint64_t telemetry_frames;
+    latencies_t ack_latencies;
+    latencies_t broadcast_latencies;
+} typedef stats_t;
+
+static client_t *clients;
+static int clients_count = 0;
+static int clients_open = 0;
+static setpoint_slot_t setpoint_slots[SLOT_COUNT];
+static ack_slot_t ack_slots[SLOT_COUNT];
+static stats_t stats;
+static uint32_t next_command_id = 1;
+static int zones = 1;
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void add_latency(latencies_t *p_latencies, uint64_t p_ns) {
+    if (p_latencies->count == p_latencies->capacity) {
+        p_latencies->capacity = p_latencies->capacity ? p_latencies->capacity * 2 : 1024;
+        p_latencies->values =
+            realloc(p_latencies->values, p_latencies->capacity * sizeof(*p_latencies->values));
+    }
+
+    p_latencies->values[p_latencies->count++] = p_ns / 1000;
+}
+
+static int compare_u32(const void *p_a, const void *p_b) {
+    uint32_t a = *(const uint32_t *)p_a;
+    uint32_t b = *(const uint32_t *)p_b;
+    return (a > b) - (a < b);
+}
+
+static uint32_t percentile(const latencies_t *p_latencies, int p_percent) {
+    if (p_latencies->count == 0) {
+        return 0;
+    }
+
+    size_t index = p_latencies->count * p_percent / 100;
+    return p_latencies->values[index < p_latencies->count ? index : p_latencies->count - 1];
+}
+
+static long read_rss_kb(pid_t p_pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", p_pid);
+
+    long rss_kb = 0;
+    FILE *fp = fopen(path, "r");
+    char line[128];
+    while (fp && fgets(line, sizeof(line), fp)) {
+        sscanf(line, "VmRSS: %ld kB", &rss_kb);
+    }
+    if (fp) {
+        fclose(fp);
+    }
+
+    return rss_kb;
+}
+
+static bool send_all(int p_fd, const void *p_data, size_t p_len) {
+    const uint8_t *data = p_data;
+    while (p_len > 0) {
+        ssize_t sent = send(p_fd, data, p_len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        p_len -= sent;
+    }
+
+    return true;
+}
+
+static void close_client(client_t *p_client) {
+    if (p_client->open) {
+        close(p_client->fd);
+        p_client->open = false;
+        clients_open--;
+    }
+}
+
+// client frames are always masked
+static bool send_text(client_t *p_client, const char *p_text) {
+    size_t len = strlen(p_text);
+    uint8_t frame[16 + 512];
+    if (len > 512) {
+        return false;
+    }
+
+    size_t header_len = 2;
+    frame[0] = 0x81;
+    if (len < 126) {
+        frame[1] = 0x80 | len;
+    } else {
+        frame[1] = 0x80 | 126;
+        frame[2] = len >> 8;
+        frame[3] = len;
+        header_len = 4;
+    }
+
+    uint32_t mask = rand();
+    memcpy(frame + header_len, &mask, 4);
+    uint8_t *mask_bytes = frame + header_len;
+    header_len += 4;
+
+    for (size_t i = 0; i < len; i++) {
+        frame[header_len + i] = p_text[i] ^ mask_bytes[i % 4];
+    }
+
+    if (!send_all(p_client->fd, frame, header_len + len)) {
+        close_client(p_client);
+        return false;
+    }
+
+    return true;
+}
+
+static connect_result_t connect_client(client_t *p_client, const char *p_host, uint16_t p_port) {
+    p_client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(p_port)};
+    inet_pton(AF_INET, p_host, &addr.sin_addr);
+
+    if (connect(p_client->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        close(p_client->fd);
+        return CONNECT_REFUSED;
+    }
+
+    int enable = 1;
+    setsockopt(p_client->fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    char request[256];
+    int request_len = snprintf(request,
+                               sizeof(request),
+                               "GET /ws HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n"
+                               "Connection: Upgrade\r\n"
+                               "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                               "Sec-WebSocket-Version: 13\r\n\r\n",
+                               p_host);
+    if (!send_all(p_client->fd, request, request_len)) {
+        close(p_client->fd);
+        return CONNECT_REFUSED;
+    }
+
+    // read the response header byte by byte so no frame that follows it is consumed
+    char response[512];
+    size_t len = 0;
+    struct pollfd poll_fd = {.fd = p_client->fd, .events = POLLIN};
+    while (len < sizeof(response) - 1) {
+        if (poll(&poll_fd, 1, 1000) <= 0 || recv(p_client->fd, response + len, 1, 0) != 1) {
+            close(p_client->fd);
+            return len == 0 ? CONNECT_REFUSED : CONNECT_REJECTED;
+        }
+        len++;
+        response[len] = '\0';
+        if (len >= 4 && !memcmp(response + len - 4, "\r\n\r\n", 4)) {
+            break;
+        }
+    }
+
+    if (strncmp(response, "HTTP/1.1 101 ", 13)) {
+        char *line_end = strstr(response, "\r\n");
+        if (line_end) {
+            *line_end = '\0';
+        }
+        fprintf(stderr, "error: handshake answered with \"%s\"\n", response);
+        close(p_client->fd);
+        return CONNECT_REJECTED;
+    }
+
+    p_client->open = true;
+    for (int zone = 0; zone < MAX_ZONES; zone++) {
+        p_client->last_target[zone] = -1;
+    }
+    clients_open++;
+    return CONNECT_OK;
+}
+
+static void finish_setpoint_slot(setpoint_slot_t *p_slot) {
+    if (p_slot->in_use && p_slot->received < p_slot->expected) {
+        stats.broadcasts_dropped += p_slot->expected - p_slot->received;
+    }
+    p_slot->in_use = false;
+}
+
+static void send_command(client_t *p_client) {
+    uint32_t id = next_command_id++;
+    int roll = rand() % 100;
+    command_kind_t kind = roll < 80   ? COMMAND_SETPOINT
+                          : roll < 90 ? COMMAND_POWER
+                                      : COMMAND_REJECTED;
+    int zone = rand() % zones;
+
+    char text[128];
+    if (kind == COMMAND_SETPOINT) {
+        setpoint_slot_t *slot = &setpoint_slots[id % SLOT_COUNT];
+        finish_setpoint_slot(slot);
+        *slot = (setpoint_slot_t){.in_use = true, .sent_ns = now_ns(), .expected = clients_open};
+
+        snprintf(text,
+                 sizeof(text),
+                 "{\"seq\":%u,\"ops\":[{\"zone\":%d,\"target_temperature\":%.2f}]}",
+                 id,
+                 zone,
+                 SETPOINT_BASE + (id % SLOT_COUNT) / 100.f);
+    } else if (kind == COMMAND_POWER) {
+        snprintf(text,
+                 sizeof(text),
+                 "{\"seq\":%u,\"ops\":[{\"zone\":%d,\"heater_state\":%s}]}",
+                 id,
+                 zone,
+                 rand() % 2 ? "true" : "false");
+    } else {
+        snprintf(text,
+                 sizeof(text),
+                 "{\"seq\":%u,\"ops\":[{\"zone\":%d,\"target_temperature\":120}]}",
+                 id,
+                 zone);
+    }
+
+    ack_slots[id % SLOT_COUNT] = (ack_slot_t){.in_use = true, .sent_ns = now_ns(), .kind = kind};
+    stats.commands_sent[kind]++;
+    send_text(p_client, text);
+}
+
+static void on_frame(client_t *p_client, char *p_text) {
+    uint64_t now = now_ns();
+
+    char *ack = strstr(p_text, "\"ack\":");
+    char *nack = strstr(p_text, "\"nack\":");
+    if (ack || nack) {
+        uint32_t seq = strtoul(ack ? ack + 6 : nack + 7, NULL, 10);
+        ack_slot_t *slot = &ack_slots[seq % SLOT_COUNT];
+        if (slot->in_use) {
+            add_latency(&stats.ack_latencies, now - slot->sent_ns);
+            if (nack && slot->kind != COMMAND_REJECTED) {
+                stats.unexpected_nacks++;
+            }
+            slot->in_use = false;
+        }
+        ack ? stats.acks++ : stats.nacks++;
+        return;
+    }
+
+    if (strstr(p_text, "\"current_temperature\"")) {
+        stats.telemetry_frames++;
+        return;
+    }
+
+    // { "zones":[{"zone":0,"target_temperature":..,"heater_state":..},...]}
+    char *entry = p_text;
+    while ((entry = strstr(entry, "\"zone\":"))) {
+        entry += strlen("\"zone\":");
+        int zone = atoi(entry);
+        char *next = strstr(entry, "\"zone\":");
+        char *target = strstr(entry, "\"target_temperature\":");
+        if (zone < 0 || zone >= MAX_ZONES || !target || (next && target > next)) {
+            continue;
+        }
+
+        float value = strtof(target + strlen("\"target_temperature\":"), NULL);
+        int index = lroundf((value - SETPOINT_BASE) * 100);
+        if (index == p_client->last_target[zone]) {
+            continue;
+        }
+        p_client->last_target[zone] = index;
+
+        if (index >= 0 && index < SLOT_COUNT && setpoint_slots[index].in_use) {
+            add_latency(&stats.broadcast_latencies, now - setpoint_slots[index].sent_ns);
+            setpoint_slots[index].received++;
+            stats.broadcasts++;
+        }
+    }
+}
+
+static void receive(client_t *p_client) {
+    ssize_t received =
+        recv(p_client->fd, p_client->buf + p_client->len, RECV_BUFFER_SIZE - p_client->len - 1, 0);
+    if (received <= 0) {
+        close_client(p_client);
+        return;
+    }
+    p_client->len += received;
+
+    // server frames are never masked
+    while (p_client->len >= 2) {
+        uint8_t *buf = p_client->buf;
+        int opcode = buf[0] & 0x0f;
+        size_t payload_len = buf[1] & 0x7f;
+        size_t header_len = 2;
+        if (payload_len == 126) {
+            if (p_client->len < 4) {
+                return;
+            }
+            payload_len = (buf[2] << 8) | buf[3];
+            header_len = 4;
+        } else if (payload_len == 127) {
+            close_client(p_client);
+            return;
+        }
+
+        if (header_len + payload_len >= RECV_BUFFER_SIZE) {
+            close_client(p_client);
+            return;
+        }
+        if (p_client->len < header_len + payload_len) {
+            return;
+        }
+
+        if (opcode == 0x8) {
+            close_client(p_client);
+            return;
+        } else if (opcode == 0x1) {
+            char saved = buf[header_len + payload_len];
+            buf[header_len + payload_len] = '\0';
+            on_frame(p_client, (char *)buf + header_len);
+            buf[header_len + payload_len] = saved;
+        }
+
+        size_t consumed = header_len + payload_len;
+        memmove(buf, buf + consumed, p_client->len - consumed);
+        p_client->len -= consumed;
+    }
+}
+
+static void run(double p_rate, uint64_t p_duration_ns) {
+    struct pollfd *poll_fds = calloc(clients_count, sizeof(struct pollfd));
+    uint64_t interval_ns = p_rate > 0 ? 1e9 / p_rate : UINT64_MAX;
+
+    // spread the first command of every client over one interval
+    uint64_t start = now_ns();
+    for (int i = 0; i < clients_count; i++) {
+        clients[i].next_send_ns = start + (p_rate > 0 ? (uint64_t)rand() % interval_ns : 0);
+    }
+
+    uint64_t send_until = start + p_duration_ns;
+    uint64_t drain_until = send_until + DRAIN_MS * 1000000ULL;
+    while (true) {
+        uint64_t now = now_ns();
+        if (now >= drain_until || clients_open == 0) {
+            break;
+        }
+
+        int timeout_ms = 10;
+        for (int i = 0; i < clients_count; i++) {
+            client_t *client = &clients[i];
+            if (client->open && now < send_until && now >= client->next_send_ns) {
+                send_command(client);
+                // +-50% jitter around the configured rate
+                client->next_send_ns += interval_ns / 2 + (uint64_t)rand() % interval_ns;
+            }
+            poll_fds[i] = (struct pollfd){.fd = client->open ? client->fd : -1, .events = POLLIN};
+        }
+
+        if (poll(poll_fds, clients_count, timeout_ms) <= 0) {
+            continue;
+        }
+
+        for (int i = 0; i < clients_count; i++) {
+            if (clients[i].open && (poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                receive(&clients[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        finish_setpoint_slot(&setpoint_slots[i]);
+    }
+
+    free(poll_fds);
+}
+
+// the sim stdout stays in p_output until it exits, its stats are printed after the report
+static pid_t start_sim(const char *p_path, uint16_t p_port, FILE **p_output) {
+    int output_pipe[2];
+    if (pipe(output_pipe)) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char port[8];
+        char zones_arg[8];
+        snprintf(port, sizeof(port), "%d", p_port);
+        snprintf(zones_arg, sizeof(zones_arg), "%d", zones);
+        dup2(output_pipe[1], STDOUT_FILENO);
+        close(output_pipe[0]);
+        close(output_pipe[1]);
+        execl(p_path, p_path, "--port", port, "--zones", zones_arg, (char *)NULL);
+        perror("execl");
+        _exit(1);
+    }
+    close(output_pipe[1]);
+
+    // a listening socket is not enough, /ws is registered after the server starts
+    FILE *output = fdopen(output_pipe[0], "r");
+    struct pollfd poll_fd = {.fd = output_pipe[0], .events = POLLIN};
+    char line[256];
+    if (poll(&poll_fd, 1, SIM_START_TIMEOUT_MS) > 0 && fgets(line, sizeof(line), output) &&
+        !strncmp(line, SIM_READY_LINE, strlen(SIM_READY_LINE))) {
+        *p_output = output;
+        return pid;
+    }
+
+    fclose(output);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void write_json(const char *p_path,
+                       const char *p_label,
+                       int p_clients,
+                       int p_clients_refused,
+                       int p_clients_rejected,
+                       double p_rate,
+                       long p_rss_start_kb,
+                       long p_rss_end_kb) {
+    FILE *fp = fopen(p_path, "w");
+    if (!fp) {
+        fprintf(stderr, "failed to open %s\n", p_path);
+        return;
+    }
+
+    uint64_t sent = stats.commands_sent[0] + stats.commands_sent[1] + stats.commands_sent[2];
+    fprintf(fp,
+            "{\n  \"label\": \"%s\",\n  \"zones\": %d,\n  \"clients\": %d,\n"
+            "  \"clients_connected\": %d,\n  \"clients_refused\": %d,\n"
+            "  \"clients_rejected\": %d,\n"
+            "  \"rate_per_client\": %.2f,\n  \"commands_sent\": %llu,\n  \"acks\": %llu,\n"
+            "  \"nacks\": %llu,\n  \"unexpected_nacks\": %llu,\n  \"acks_dropped\": %llu,\n"
+            "  \"broadcasts\": %llu,\n  \"broadcasts_dropped\": %llu,\n"
+            "  \"telemetry_frames\": %llu,\n"
+            "  \"ack_latency_us\": {\"p50\": %u, \"p99\": %u, \"max\": %u},\n"
+            "  \"broadcast_latency_us\": {\"p50\": %u, \"p99\": %u, \"max\": %u},\n"
+            "  \"rss_start_kb\": %ld,\n  \"rss_end_kb\": %ld\n}\n",
+            p_label,
+            zones,
+            p_clients,
+            clients_count,
+            p_clients_refused,
+            p_clients_rejected,
+            p_rate,
+            (unsigned long long)sent,
+            (unsigned long long)stats.acks,
+            (unsigned long long)stats.nacks,
+            (unsigned long long)stats.unexpected_nacks,
+            (unsigned long long)(sent - stats.acks - stats.nacks),
+            (unsigned long long)stats.broadcasts,
+            (unsigned long long)stats.broadcasts_dropped,
+            (unsigned long long)stats.telemetry_frames,
+            percentile(&stats.ack_latencies, 50),
+            percentile(&stats.ack_latencies, 99),
+            percentile(&stats.ack_latencies, 100),
+            percentile(&stats.broadcast_latencies, 50),
+            percentile(&stats.broadcast_latencies, 99),
+            percentile(&stats.broadcast_latencies, 100),
+            p_rss_start_kb,
+            p_rss_end_kb);
+
+    fclose(fp);
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    uint16_t port = DEFAULT_PORT;
+    int requested_clients = 4;
+    int clients_refused = 0;
+    int clients_rejected = 0;
+    double rate = 1;
+    double duration_s = 10;
+    const char *sim_path = NULL;
+    const char *json_path = NULL;
+    const char *label = "";
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--host") && i + 1 < argc) {
+            host = argv[++i];
+        } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--clients") && i + 1 < argc) {
+            requested_clients = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+            duration_s = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--zones") && i + 1 < argc) {
+            zones = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--sim") && i + 1 < argc) {
+            sim_path = argv[++i];
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (!strcmp(argv[i], "--label") && i + 1 < argc) {
+            label = argv[++i];
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--host <ip>] [--port <port>] [--clients <n>] "
+                    "[--rate <commands/s/client>] [--duration <s>] [--zones <n>] "
+                    "[--sim <path>] [--json <path>] [--label <name>]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (zones < 1 || zones > MAX_ZONES) {
+        fprintf(stderr, "--zones must be within 1..%d\n", MAX_ZONES);
+        return 1;
+    }
+
+    srand(time(NULL));
+
+    pid_t sim_pid = -1;
+    FILE *sim_output = NULL;
+    if (sim_path) {
+        sim_pid = start_sim(sim_path, port, &sim_output);
+        if (sim_pid < 0) {
+            fprintf(stderr, "sim did not get ready on port %d\n", port);
+            return 1;
+        }
+    }
+
+    // refused clients are left out of the run, rejected ones fail it
+    clients = calloc(requested_clients, sizeof(client_t));
+    for (int i = 0; i < requested_clients; i++) {
+        connect_result_t result = connect_client(&clients[clients_count], host, port);
+        if (result == CONNECT_OK) {
+            clients_count++;
+        } else if (result == CONNECT_REFUSED) {
+            clients_refused++;
+        } else {
+            clients_rejected++;
+        }
+    }
+
+    // let the handshake state frames arrive before measuring
+    usleep(500 * 1000);
+    for (int i = 0; i < clients_count; i++) {
+        struct pollfd poll_fd = {.fd = clients[i].fd, .events = POLLIN};
+        while (clients[i].open && poll(&poll_fd, 1, 0) > 0) {
+            receive(&clients[i]);
+        }
+    }
+    stats = (stats_t){0};
+
+    long rss_start_kb = sim_pid > 0 ? read_rss_kb(sim_pid) : 0;
+
+    run(rate, duration_s * 1e9);
+
+    long rss_end_kb = sim_pid > 0 ? read_rss_kb(sim_pid) : 0;
+
+    for (int i = 0; i < clients_count; i++) {
+        close_client(&clients[i]);
+    }
+
+    qsort(stats.ack_latencies.values, stats.ack_latencies.count, sizeof(uint32_t), compare_u32);
+    qsort(stats.broadcast_latencies.values,
+          stats.broadcast_latencies.count,
+          sizeof(uint32_t),
+          compare_u32);
+
+    uint64_t sent = stats.commands_sent[0] + stats.commands_sent[1] + stats.commands_sent[2];
+    printf("zones %d, clients %d/%d connected (%d refused, %d rejected), "
+           "%.1f commands/s each for %.0f s\n",
+           zones,
+           clients_count,
+           requested_clients,
+           clients_refused,
+           clients_rejected,
+           rate,
+           duration_s);
+    printf("commands %llu (setpoint %llu, power %llu, rejected %llu)\n",
+           (unsigned long long)sent,
+           (unsigned long long)stats.commands_sent[COMMAND_SETPOINT],
+           (unsigned long long)stats.commands_sent[COMMAND_POWER],
+           (unsigned long long)stats.commands_sent[COMMAND_REJECTED]);
+    printf("acks %llu, nacks %llu (%llu unexpected), missing %llu\n",
+           (unsigned long long)stats.acks,
+           (unsigned long long)stats.nacks,
+           (unsigned long long)stats.unexpected_nacks,
+           (unsigned long long)(sent - stats.acks - stats.nacks));
+    printf("broadcasts %llu, dropped %llu, telemetry frames %llu\n",
+           (unsigned long long)stats.broadcasts,
+           (unsigned long long)stats.broadcasts_dropped,
+           (unsigned long long)stats.telemetry_frames);
+    printf("command -> ack        p50 %6.2f ms  p99 %6.2f ms  max %6.2f ms\n",
+           percentile(&stats.ack_latencies, 50) / 1000.,
+           percentile(&stats.ack_latencies, 99) / 1000.,
+           percentile(&stats.ack_latencies, 100) / 1000.);
+    printf("command -> broadcast  p50 %6.2f ms  p99 %6.2f ms  max %6.2f ms\n",
+           percentile(&stats.broadcast_latencies, 50) / 1000.,
+           percentile(&stats.broadcast_latencies, 99) / 1000.,
+           percentile(&stats.broadcast_latencies, 100) / 1000.);
+    if (sim_pid > 0) {
+        printf("sim rss %ld kB -> %ld kB (%+ld kB)\n",
+               rss_start_kb,
+               rss_end_kb,
+               rss_end_kb - rss_start_kb);
+    }
+    fflush(stdout);
+
+    if (json_path) {
+        write_json(json_path,
+                   label,
+                   requested_clients,
+                   clients_refused,
+                   clients_rejected,
+                   rate,
+                   rss_start_kb,
+                   rss_end_kb);
+    }
+
+    if (sim_pid > 0) {
+        kill(sim_pid, SIGTERM);
+        waitpid(sim_pid, NULL, 0);
+
+        char line[256];
+        while (fgets(line, sizeof(line), sim_output)) {
+            fputs(line, stdout);
+        }
+        fclose(sim_output);
+    }
+
+    if (clients_rejected > 0) {
+        fprintf(stderr,
+                "error: %d of %d handshakes rejected\n",
+                clients_rejected,
+                requested_clients);
+        return 1;
+    }
+
+    return 0;
+}
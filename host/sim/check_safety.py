@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""Inject one fault per safety check into sim and fail when a check does not trip in its window,
+or when a cook without an injected fault trips anything.
+
+usage: check_safety.py <path to sim> [--time-scale <n>] [--port <port>]
+
+The windows are the ones documented in the README, plus one control period, one supervisor
+check and the read retries for the reading that shows the fault.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+SLACK_MS = 1000 + 100 + 3 * 50
+
+# name, sim arguments, injection, injected at s, documented window in ms, expected fault
+SCENARIOS = [
+    ("stale", [], "read_error,0", 20, 5000, "sensor_stale"),
+    ("implausible", ["--target", "60"], "override,120", 20, 0, "sensor_implausible"),
+    ("stuck", ["--target", "60"], "stuck,0", 60, 10 * 60 * 1000, "sensor_stuck"),
+    # out of the water the probe reads the air around the pot
+    ("no_response", ["--target", "90"], "probe_out,20", 60, 10 * 60 * 1000, "no_response"),
+    ("dry_run", ["--target", "60"], "dry_run,0.2", 60, 30 * 1000, "dry_run"),
+    # heater off, something else heats the bath
+    ("runaway", [], "external_heat,2000", 60, 60 * 1000, "runaway"),
+]
+
+# name, sim arguments, duration in s, no zone may trip
+FAULT_FREE = [
+    # long enough for the controller to settle below the target at a steady duty
+    ("cook", ["--target", "60"], 2 * 60 * 60),
+]
+
+RESULT = re.compile(r"zone 0 .*, fault (\w+)(?:, detected (\d+) ms after injection)?")
+
+
+def run(sim, scenario, time_scale, port):
+    name, args, injection, at_s, window_ms, expected = scenario
+    duration_s = at_s + (window_ms + SLACK_MS) / 1000 + 10
+    command = [sim, "--port", str(port), "--time-scale", str(time_scale), "--read-us", "0",
+               "--duration", str(duration_s), "--inject", f"0,{injection},{at_s}"] + args
+    output = subprocess.run(command, capture_output=True, text=True, check=True).stdout
+
+    match = RESULT.search(output)
+    fault = match.group(1) if match else "none"
+    latency_ms = int(match.group(2)) if match and match.group(2) else None
+
+    ok = fault == expected and latency_ms is not None and latency_ms <= window_ms + SLACK_MS
+    detected = f"{latency_ms} ms" if latency_ms is not None else "not detected"
+    print(f"{name:12} {fault:20} {detected:>14}  window {window_ms + SLACK_MS:>7} ms  "
+          f"{'ok' if ok else 'FAIL'}")
+    return ok
+
+
+def run_fault_free(sim, scenario, time_scale, port):
+    name, args, duration_s = scenario
+    command = [sim, "--port", str(port), "--time-scale", str(time_scale), "--read-us", "0",
+               "--duration", str(duration_s)] + args
+    output = subprocess.run(command, capture_output=True, text=True, check=True).stdout
+
+    match = RESULT.search(output)
+    fault = match.group(1) if match else "no result"
+
+    ok = fault == "none"
+    print(f"{name:12} {fault:20} {'':>14}  for     {duration_s * 1000:>7} ms  "
+          f"{'ok' if ok else 'FAIL'}")
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("sim")
+    parser.add_argument("--time-scale", type=int, default=100,
+                        help="simulated seconds per host second")
+    parser.add_argument("--port", type=int, default=8090)
+    args = parser.parse_args()
+
+    ok = True
+    for i, scenario in enumerate(SCENARIOS):
+        ok &= run(args.sim, scenario, args.time_scale, args.port + i)
+    for i, scenario in enumerate(FAULT_FREE):
+        ok &= run_fault_free(args.sim, scenario, args.time_scale, args.port + len(SCENARIOS) + i)
+
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,712 @@
+#include "sim_httpd.h"
+
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// esp_http_server on POSIX sockets, modelled on how the IDF server schedules work:
+// one thread owns every session, queued work runs on that thread one item per loop
+// iteration and the work queue is as short as the lwip control socket mailbox
+
+#define TAG "httpd"
+
+#define MAX_URI_HANDLERS 16
+#define RECV_BUFFER_SIZE 4096
+#define WORK_QUEUE_SIZE CONFIG_LWIP_UDP_RECVMBOX_SIZE
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+struct {
+    int fd;
+    bool websocket;
+    const char *content_type;
+    size_t len;
+    uint8_t buf[RECV_BUFFER_SIZE];
+
+    // frame handed to the uri handler through httpd_ws_recv_frame
+    httpd_ws_type_t frame_type;
+    uint8_t *frame_payload;
+    size_t frame_len;
+} typedef session_t;
+
+struct {
+    httpd_work_fn_t fn;
+    void *arg;
+} typedef work_t;
+
+struct {
+    httpd_config_t config;
+    int listen_fd;
+    int ctrl_pipe[2];
+    pthread_t thread;
+
+    pthread_mutex_t mutex; // uri handlers, sessions and work queue
+    httpd_uri_t handlers[MAX_URI_HANDLERS];
+    int handlers_count;
+
+    session_t *sessions;
+    work_t work_queue[WORK_QUEUE_SIZE];
+    int work_start;
+    int work_count;
+
+    sim_httpd_stats_t stats;
+} typedef server_t;
+
+static server_t server;
+static uint16_t port_override = 0;
+static uint16_t max_open_sockets_override = 0;
+
+static void *server_loop(void *p_arg);
+static void accept_session();
+static void close_session(session_t *p_session);
+static void process_http(session_t *p_session);
+static void process_ws(session_t *p_session);
+static esp_err_t send_all(int p_fd, const void *p_data, size_t p_len);
+static esp_err_t send_frame(int p_fd, httpd_ws_type_t p_type, const uint8_t *p_payload, size_t p_len);
+static session_t *find_session(int p_fd);
+static bool find_handler(const char *p_uri, httpd_uri_t *p_handler);
+static void websocket_accept_key(const char *p_key, char *p_accept);
+
+void sim_httpd_set_port(uint16_t p_port) {
+    port_override = p_port;
+}
+
+void sim_httpd_set_max_open_sockets(uint16_t p_max_open_sockets) {
+    max_open_sockets_override = p_max_open_sockets;
+}
+
+sim_httpd_stats_t sim_httpd_get_stats() {
+    pthread_mutex_lock(&server.mutex);
+    sim_httpd_stats_t stats = server.stats;
+    pthread_mutex_unlock(&server.mutex);
+    return stats;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    server.config = *config;
+    if (port_override) {
+        server.config.server_port = port_override;
+    }
+    if (max_open_sockets_override) {
+        server.config.max_open_sockets = max_open_sockets_override;
+    }
+
+    server.sessions = calloc(server.config.max_open_sockets, sizeof(session_t));
+    if (!server.sessions) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < server.config.max_open_sockets; i++) {
+        server.sessions[i].fd = -1;
+    }
+
+    pthread_mutex_init(&server.mutex, NULL);
+
+    server.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(server.listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(server.config.server_port),
+                               .sin_addr.s_addr = htonl(INADDR_ANY)};
+    if (bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(server.listen_fd, server.config.max_open_sockets)) {
+        ESP_LOGE(TAG, "failed to listen on port %d: %s", server.config.server_port, strerror(errno));
+        close(server.listen_fd);
+        return ESP_FAIL;
+    }
+
+    if (pipe(server.ctrl_pipe)) {
+        close(server.listen_fd);
+        return ESP_FAIL;
+    }
+
+    if (pthread_create(&server.thread, NULL, server_loop, NULL)) {
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG,
+             "listening on port %d, %d open sockets",
+             server.config.server_port,
+             server.config.max_open_sockets);
+
+    *handle = &server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// the server thread is already accepting, like on the device requests that arrive before
+// their handler is registered get a 404
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    pthread_mutex_lock(&server.mutex);
+
+    if (server.handlers_count == MAX_URI_HANDLERS) {
+        pthread_mutex_unlock(&server.mutex);
+        return ESP_ERR_NO_MEM;
+    }
+
+    server.handlers[server.handlers_count++] = *uri_handler;
+
+    pthread_mutex_unlock(&server.mutex);
+    return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+    if (!handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&server.mutex);
+
+    if (server.work_count == WORK_QUEUE_SIZE) {
+        server.stats.work_dropped++;
+        pthread_mutex_unlock(&server.mutex);
+        return ESP_FAIL;
+    }
+
+    server.work_queue[(server.work_start + server.work_count) % WORK_QUEUE_SIZE] =
+        (work_t){.fn = work, .arg = arg};
+    server.work_count++;
+    server.stats.work_queued++;
+
+    pthread_mutex_unlock(&server.mutex);
+
+    char wake = 0;
+    write(server.ctrl_pipe[1], &wake, 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds) {
+    pthread_mutex_lock(&server.mutex);
+
+    size_t count = 0;
+    for (int i = 0; i < server.config.max_open_sockets && count < *fds; i++) {
+        if (server.sessions[i].fd >= 0) {
+            client_fds[count++] = server.sessions[i].fd;
+        }
+    }
+
+    pthread_mutex_unlock(&server.mutex);
+
+    *fds = count;
+    return ESP_OK;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+    pthread_mutex_lock(&server.mutex);
+
+    session_t *session = find_session(fd);
+    httpd_ws_client_info_t info = !session            ? HTTPD_WS_CLIENT_INVALID
+                                  : session->websocket ? HTTPD_WS_CLIENT_WEBSOCKET
+                                                       : HTTPD_WS_CLIENT_HTTP;
+
+    pthread_mutex_unlock(&server.mutex);
+    return info;
+}
+
+// blocks until the socket takes the frame, like lwip send does on the device
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+    return send_frame(fd, frame->type, frame->payload, frame->len);
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+    session_t *session = req->aux;
+    if (!session || !session->frame_payload) {
+        return ESP_FAIL;
+    }
+
+    pkt->type = session->frame_type;
+    pkt->final = true;
+    pkt->fragmented = false;
+
+    if (max_len == 0) {
+        pkt->len = session->frame_len;
+        return ESP_OK;
+    }
+
+    if (!pkt->payload) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pkt->len = session->frame_len < max_len ? session->frame_len : max_len;
+    memcpy(pkt->payload, session->frame_payload, pkt->len);
+    return ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    session_t *session = r->aux;
+    return session ? session->fd : -1;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    session_t *session = r->aux;
+    session->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    session_t *session = r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? strlen(buf) : 0;
+    }
+
+    char header[256];
+    int header_len = snprintf(header,
+                              sizeof(header),
+                              "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zd\r\n"
+                              "Connection: close\r\n\r\n",
+                              session->content_type ? session->content_type : "text/html",
+                              buf_len);
+
+    esp_err_t ret = send_all(session->fd, header, header_len);
+    if (ret == ESP_OK && buf_len > 0) {
+        ret = send_all(session->fd, buf, buf_len);
+    }
+    return ret;
+}
+
+static void *server_loop(void *p_arg) {
+    int max_sessions = server.config.max_open_sockets;
+    struct pollfd *poll_fds = calloc(max_sessions + 2, sizeof(struct pollfd));
+
+    while (true) {
+        poll_fds[0] = (struct pollfd){.fd = server.ctrl_pipe[0], .events = POLLIN};
+        poll_fds[1] = (struct pollfd){.fd = server.listen_fd, .events = POLLIN};
+        for (int i = 0; i < max_sessions; i++) {
+            poll_fds[i + 2] = (struct pollfd){.fd = server.sessions[i].fd, .events = POLLIN};
+        }
+
+        if (poll(poll_fds, max_sessions + 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "poll failed: %s", strerror(errno));
+            abort();
+        }
+
+        // one control message per iteration, the same as httpd_process_ctrl_msg
+        if (poll_fds[0].revents & POLLIN) {
+            char wake;
+            read(server.ctrl_pipe[0], &wake, 1);
+
+            pthread_mutex_lock(&server.mutex);
+            work_t work = server.work_queue[server.work_start];
+            server.work_start = (server.work_start + 1) % WORK_QUEUE_SIZE;
+            server.work_count--;
+            pthread_mutex_unlock(&server.mutex);
+
+            work.fn(work.arg);
+        }
+
+        if (poll_fds[1].revents & POLLIN) {
+            accept_session();
+        }
+
+        for (int i = 0; i < max_sessions; i++) {
+            session_t *session = &server.sessions[i];
+            if (session->fd < 0 || session->fd != poll_fds[i + 2].fd ||
+                !(poll_fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+
+            ssize_t received =
+                recv(session->fd, session->buf + session->len, RECV_BUFFER_SIZE - session->len, 0);
+            if (received <= 0) {
+                close_session(session);
+                continue;
+            }
+
+            session->len += received;
+            if (session->websocket) {
+                process_ws(session);
+            } else {
+                process_http(session);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void accept_session() {
+    int fd = accept(server.listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    int enable = 1;
+    int send_buffer = CONFIG_LWIP_TCP_SND_BUF_DEFAULT;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+
+    pthread_mutex_lock(&server.mutex);
+
+    session_t *session = NULL;
+    for (int i = 0; i < server.config.max_open_sockets; i++) {
+        if (server.sessions[i].fd < 0) {
+            session = &server.sessions[i];
+            break;
+        }
+    }
+
+    if (session) {
+        memset(session, 0, sizeof(session_t));
+        session->fd = fd;
+        server.stats.sessions_accepted++;
+    } else {
+        server.stats.sessions_rejected++;
+    }
+
+    pthread_mutex_unlock(&server.mutex);
+
+    if (!session) {
+        ESP_LOGW(TAG, "no free session for fd %d", fd);
+        close(fd);
+    }
+}
+
+static void close_session(session_t *p_session) {
+    pthread_mutex_lock(&server.mutex);
+    int fd = p_session->fd;
+    p_session->fd = -1;
+    pthread_mutex_unlock(&server.mutex);
+
+    close(fd);
+}
+
+static void process_http(session_t *p_session) {
+    char *request = (char *)p_session->buf;
+    char *end = memmem(request, p_session->len, "\r\n\r\n", 4);
+    if (!end) {
+        if (p_session->len == RECV_BUFFER_SIZE) {
+            close_session(p_session);
+        }
+        return;
+    }
+    *end = '\0';
+
+    char method[8] = {0};
+    char uri[CONFIG_HTTPD_MAX_REQ_HDR_LEN] = {0};
+    sscanf(request, "%7s %511s", method, uri);
+
+    char key[64] = {0};
+    bool upgrade = false;
+    for (char *line = strstr(request, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        if (!strncasecmp(line + 2, "Upgrade:", 8) && strcasestr(line + 10, "websocket")) {
+            upgrade = true;
+        } else if (!strncasecmp(line + 2, "Sec-WebSocket-Key:", 18)) {
+            sscanf(line + 20, " %63[^\r]", key);
+        }
+    }
+
+    httpd_uri_t handler;
+    bool found = !strcmp(method, "GET") && find_handler(uri, &handler);
+
+    httpd_req_t req = {.handle = &server, .method = HTTP_GET, .aux = p_session};
+    strncpy((char *)req.uri, uri, sizeof(req.uri) - 1);
+
+    if (!found) {
+        const char *not_found = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        send_all(p_session->fd, not_found, strlen(not_found));
+        close_session(p_session);
+        return;
+    }
+
+    req.user_ctx = handler.user_ctx;
+
+    if (!handler.is_websocket || !upgrade || !key[0]) {
+        handler.handler(&req);
+        close_session(p_session);
+        return;
+    }
+
+    char accept[32];
+    websocket_accept_key(key, accept);
+
+    char response[256];
+    int response_len = snprintf(response,
+                                sizeof(response),
+                                "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                                "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n",
+                                accept);
+
+    size_t consumed = end + 4 - request;
+    memmove(p_session->buf, p_session->buf + consumed, p_session->len - consumed);
+    p_session->len -= consumed;
+
+    if (send_all(p_session->fd, response, response_len) != ESP_OK) {
+        close_session(p_session);
+        return;
+    }
+
+    pthread_mutex_lock(&server.mutex);
+    p_session->websocket = true;
+    pthread_mutex_unlock(&server.mutex);
+
+    // the IDF server calls websocket handlers with HTTP_GET once the handshake is done
+    if (handler.handler(&req) != ESP_OK) {
+        close_session(p_session);
+        return;
+    }
+
+    if (p_session->len > 0) {
+        process_ws(p_session);
+    }
+}
+
+static void process_ws(session_t *p_session) {
+    while (p_session->fd >= 0 && p_session->len >= 2) {
+        uint8_t *buf = p_session->buf;
+        httpd_ws_type_t type = buf[0] & 0x0f;
+        bool final = buf[0] & 0x80;
+        bool masked = buf[1] & 0x80;
+        uint64_t payload_len = buf[1] & 0x7f;
+
+        size_t header_len = 2;
+        if (payload_len == 126) {
+            header_len += 2;
+        } else if (payload_len == 127) {
+            header_len += 8;
+        }
+        if (masked) {
+            header_len += 4;
+        }
+        if (p_session->len < header_len) {
+            return;
+        }
+
+        if (payload_len == 126) {
+            payload_len = (buf[2] << 8) | buf[3];
+        } else if (payload_len == 127) {
+            payload_len = 0;
+            for (int i = 0; i < 8; i++) {
+                payload_len = (payload_len << 8) | buf[2 + i];
+            }
+        }
+
+        if (!final || !masked || header_len + payload_len > RECV_BUFFER_SIZE) {
+            ESP_LOGW(TAG, "unsupported frame on fd %d", p_session->fd);
+            close_session(p_session);
+            return;
+        }
+        if (p_session->len < header_len + payload_len) {
+            return;
+        }
+
+        uint8_t *mask = buf + header_len - 4;
+        uint8_t *payload = buf + header_len;
+        for (uint64_t i = 0; i < payload_len; i++) {
+            payload[i] ^= mask[i % 4];
+        }
+
+        pthread_mutex_lock(&server.mutex);
+        server.stats.frames_received++;
+        pthread_mutex_unlock(&server.mutex);
+
+        if (type == HTTPD_WS_TYPE_CLOSE) {
+            send_frame(p_session->fd, HTTPD_WS_TYPE_CLOSE, payload, payload_len < 2 ? 0 : 2);
+            close_session(p_session);
+            return;
+        } else if (type == HTTPD_WS_TYPE_PING) {
+            send_frame(p_session->fd, HTTPD_WS_TYPE_PONG, payload, payload_len);
+        } else if (type == HTTPD_WS_TYPE_TEXT || type == HTTPD_WS_TYPE_BINARY) {
+            httpd_uri_t handler;
+            bool found = find_handler(NULL, &handler);
+
+            p_session->frame_type = type;
+            p_session->frame_payload = payload;
+            p_session->frame_len = payload_len;
+
+            httpd_req_t req = {.handle = &server, .method = 0, .aux = p_session};
+            esp_err_t ret = found ? handler.handler(&req) : ESP_FAIL;
+
+            p_session->frame_payload = NULL;
+            if (ret != ESP_OK) {
+                close_session(p_session);
+                return;
+            }
+        }
+
+        size_t consumed = header_len + payload_len;
+        memmove(p_session->buf, p_session->buf + consumed, p_session->len - consumed);
+        p_session->len -= consumed;
+    }
+}
+
+static esp_err_t send_all(int p_fd, const void *p_data, size_t p_len) {
+    const uint8_t *data = p_data;
+    while (p_len > 0) {
+        ssize_t sent = send(p_fd, data, p_len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent <= 0) {
+            return ESP_FAIL;
+        }
+        data += sent;
+        p_len -= sent;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t send_frame(int p_fd, httpd_ws_type_t p_type, const uint8_t *p_payload, size_t p_len) {
+    uint8_t header[10];
+    size_t header_len = 2;
+    header[0] = 0x80 | p_type;
+    if (p_len < 126) {
+        header[1] = p_len;
+    } else if (p_len < 65536) {
+        header[1] = 126;
+        header[2] = p_len >> 8;
+        header[3] = p_len;
+        header_len = 4;
+    } else {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (uint64_t)p_len >> (56 - 8 * i);
+        }
+        header_len = 10;
+    }
+
+    esp_err_t ret = send_all(p_fd, header, header_len);
+    if (ret == ESP_OK) {
+        ret = send_all(p_fd, p_payload, p_len);
+    }
+
+    if (ret == ESP_OK) {
+        pthread_mutex_lock(&server.mutex);
+        server.stats.frames_sent++;
+        pthread_mutex_unlock(&server.mutex);
+    }
+
+    return ret;
+}
+
+// caller holds server.mutex
+static session_t *find_session(int p_fd) {
+    for (int i = 0; i < server.config.max_open_sockets; i++) {
+        if (server.sessions[i].fd == p_fd && p_fd >= 0) {
+            return &server.sessions[i];
+        }
+    }
+
+    return NULL;
+}
+
+// copies the handler out so registration can go on while it runs, a NULL uri finds the
+// websocket handler that frames of an upgraded session go to
+static bool find_handler(const char *p_uri, httpd_uri_t *p_handler) {
+    pthread_mutex_lock(&server.mutex);
+
+    bool found = false;
+    for (int i = 0; i < server.handlers_count && !found; i++) {
+        if (p_uri ? !strcmp(server.handlers[i].uri, p_uri) : server.handlers[i].is_websocket) {
+            *p_handler = server.handlers[i];
+            found = true;
+        }
+    }
+
+    pthread_mutex_unlock(&server.mutex);
+    return found;
+}
+
+static void sha1(const uint8_t *p_data, size_t p_len, uint8_t p_digest[20]) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    size_t padded_len = ((p_len + 8) / 64 + 1) * 64;
+    uint8_t *msg = calloc(padded_len, 1);
+    memcpy(msg, p_data, p_len);
+    msg[p_len] = 0x80;
+    uint64_t bit_len = (uint64_t)p_len * 8;
+    for (int i = 0; i < 8; i++) {
+        msg[padded_len - 1 - i] = bit_len >> (8 * i);
+    }
+
+    for (size_t chunk = 0; chunk < padded_len; chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (msg[chunk + 4 * i] << 24) | (msg[chunk + 4 * i + 1] << 16) |
+                   (msg[chunk + 4 * i + 2] << 8) | msg[chunk + 4 * i + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (x << 1) | (x >> 31);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = temp;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    free(msg);
+
+    for (int i = 0; i < 5; i++) {
+        p_digest[4 * i] = h[i] >> 24;
+        p_digest[4 * i + 1] = h[i] >> 16;
+        p_digest[4 * i + 2] = h[i] >> 8;
+        p_digest[4 * i + 3] = h[i];
+    }
+}
+
+static void websocket_accept_key(const char *p_key, char *p_accept) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    char concatenated[128];
+    int len = snprintf(concatenated, sizeof(concatenated), "%s%s", p_key, WS_GUID);
+
+    uint8_t digest[20];
+    sha1((const uint8_t *)concatenated, len, digest);
+
+    // base64 of 20 bytes is 28 characters with one padding character
+    int out = 0;
+    for (int i = 0; i < 20; i += 3) {
+        uint32_t triple = digest[i] << 16;
+        triple |= i + 1 < 20 ? digest[i + 1] << 8 : 0;
+        triple |= i + 2 < 20 ? digest[i + 2] : 0;
+
+        p_accept[out++] = alphabet[(triple >> 18) & 0x3f];
+        p_accept[out++] = alphabet[(triple >> 12) & 0x3f];
+        p_accept[out++] = i + 1 < 20 ? alphabet[(triple >> 6) & 0x3f] : '=';
+        p_accept[out++] = i + 2 < 20 ? alphabet[triple & 0x3f] : '=';
+    }
+    p_accept[out] = '\0';
+}
@@ -0,0 +1,428 @@
+#include "sim_httpd.h"
+
+#include <heater.h>
+#include <host_stubs.h>
+#include <mqtt_bridge.h>
+#include <safety.h>
+#include <temperature.h>
+#include <web_site.h>
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// the firmware web server, controller and safety supervisor on Linux, with one simulated
+// water bath per zone in place of the DS18B20s and the heaters
+//
+// usage: sim [--port <port>] [--max-open-sockets <n>] [--zones <n>] [--read-us <us>]
+//            [--duration <s>] [--time-scale <n>] [--target <celsius>]
+//            [--inject <zone>,<kind>,<value>,<at s>]... [--volume-l <l>] [--power-w <w>]
+//            [--ambient <celsius>] [--mqtt <interval ms>] [--mqtt-publish <topic>=<payload>]...
+//            [--mqtt-retained <topic>=<payload>]... [--verbose]
+//
+// every time is simulated time, --time-scale runs it that many times faster than the host clock
+//
+// --mqtt starts the mqtt bridge against an in-process broker that prints every publish on
+// stderr, --mqtt-publish delivers a command once it is connected and --mqtt-retained keeps one
+// on the broker like a retained message, the topics of the host build are sous-vide/000001/...
+//
+// --inject kinds, each is detected by one safety check:
+// - read_error, stuck, override <reading>: injected into the firmware sensor reads
+// - probe_out <reading>: the probe reads air at about <reading> instead of the bath
+// - dry_run <litres>: the bath boils down to <litres>
+// - external_heat <watts>: the bath is heated by something other than its heater
+
+#define DEFAULT_PORT 8080
+#define FIRST_HEATER_PIN 14
+#define TEMPERATURE_SENSOR_PIN 23
+// reset, match rom, read scratchpad and 9 bytes at standard 1-wire speed
+#define DS18B20_READ_US 12000
+
+#define BATH_STEP_MS 100
+#define WATER_HEAT_CAPACITY 4186.f // J/(kg*K)
+#define BATH_LOSS_W_PER_K 5.f
+#define PROBE_OUT_NOISE 0.1f
+#define MAX_INJECTIONS 8
+
+struct {
+    float volume_l;
+    float power_w;
+    float ambient;
+    float temperature;
+    float external_power_w;
+    bool probe_out;
+    float probe_out_reading;
+} typedef bath_t;
+
+typedef enum {
+    INJECT_READ_ERROR,
+    INJECT_STUCK,
+    INJECT_OVERRIDE,
+    INJECT_PROBE_OUT,
+    INJECT_DRY_RUN,
+    INJECT_EXTERNAL_HEAT,
+} inject_kind_t;
+
+static const char *inject_kind_names[] = {
+    "read_error", "stuck", "override", "probe_out", "dry_run", "external_heat"};
+
+struct {
+    int zone;
+    inject_kind_t kind;
+    float value;
+    uint32_t at_ms;
+    bool done;
+} typedef injection_t;
+
+static bath_t baths[MAX_ZONES];
+static int baths_count = 1;
+static injection_t injections[MAX_INJECTIONS];
+static int injections_count = 0;
+static TickType_t start_tick;
+
+static bool parse_injection(const char *p_text, injection_t *p_injection);
+static bool parse_mqtt_message(const char *p_text, bool p_retain);
+static void temperature_read_cb(const bool *p_updated);
+static void bath_loop();
+static void inject(injection_t *p_injection);
+static void print_stats(double p_elapsed_s);
+
+int main(int argc, char **argv) {
+    uint16_t port = DEFAULT_PORT;
+    uint16_t max_open_sockets = 0;
+    uint32_t read_us = DS18B20_READ_US;
+    double duration_s = 0;
+    uint32_t time_scale = 1;
+    float target = NAN;
+    bath_t bath = {.volume_l = 5.f, .power_w = 1000.f, .ambient = 20.f};
+    int mqtt_interval_ms = 0;
+    esp_log_level_t log_level = ESP_LOG_WARN;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--max-open-sockets") && i + 1 < argc) {
+            max_open_sockets = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--zones") && i + 1 < argc) {
+            baths_count = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--read-us") && i + 1 < argc) {
+            read_us = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--duration") && i + 1 < argc) {
+            duration_s = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--time-scale") && i + 1 < argc) {
+            time_scale = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--target") && i + 1 < argc) {
+            target = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--inject") && i + 1 < argc &&
+                   injections_count < MAX_INJECTIONS) {
+            if (!parse_injection(argv[++i], &injections[injections_count++])) {
+                fprintf(stderr, "invalid --inject %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--volume-l") && i + 1 < argc) {
+            bath.volume_l = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--power-w") && i + 1 < argc) {
+            bath.power_w = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--ambient") && i + 1 < argc) {
+            bath.ambient = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--mqtt") && i + 1 < argc) {
+            mqtt_interval_ms = atoi(argv[++i]);
+        } else if ((!strcmp(argv[i], "--mqtt-publish") || !strcmp(argv[i], "--mqtt-retained")) &&
+                   i + 1 < argc) {
+            bool retain = !strcmp(argv[i], "--mqtt-retained");
+            if (!parse_mqtt_message(argv[++i], retain)) {
+                fprintf(stderr, "invalid %s %s\n", argv[i - 1], argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--verbose")) {
+            log_level = ESP_LOG_INFO;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--port <port>] [--max-open-sockets <n>] [--zones <n>] "
+                    "[--read-us <us>] [--duration <s>] [--time-scale <n>] [--target <celsius>] "
+                    "[--inject <zone>,<kind>,<value>,<at s>]... [--volume-l <l>] "
+                    "[--power-w <w>] [--ambient <celsius>] [--mqtt <interval ms>] "
+                    "[--mqtt-publish <topic>=<payload>]... [--mqtt-retained <topic>=<payload>]... "
+                    "[--verbose]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    esp_log_level_set("*", log_level);
+
+    // every task inherits the mask, signals are only taken by sigwait below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (baths_count < 1 || baths_count > MAX_ZONES) {
+        fprintf(stderr, "--zones must be within 1..%d\n", MAX_ZONES);
+        return 1;
+    }
+    for (int i = 0; i < injections_count; i++) {
+        if (injections[i].zone < 0 || injections[i].zone >= baths_count) {
+            fprintf(stderr, "--inject zone must be within 0..%d\n", baths_count - 1);
+            return 1;
+        }
+    }
+
+    // before anything reads the clock, so simulated time starts where the host clock is
+    host_set_time_scale(time_scale);
+
+    // every zone gets its own bath and probe, the nvs starts empty like on a fresh device
+    zone_config_t zones[MAX_ZONES];
+    host_ds18b20_set_probes(baths_count);
+    host_ds18b20_set_read_us(read_us);
+    for (int zone = 0; zone < baths_count; zone++) {
+        baths[zone] = bath;
+        baths[zone].temperature = bath.ambient;
+        host_ds18b20_set_temperature(zone, bath.ambient);
+        zones[zone] = (zone_config_t){.heater_pin = FIRST_HEATER_PIN + zone};
+    }
+
+    init_heaters(zones, baths_count);
+    init_temperature_sensors(TEMPERATURE_SENSOR_PIN, zones, baths_count);
+
+    // the same as a user switching every zone on, before the supervisor and control loop start
+    if (!isnan(target)) {
+        for (int zone = 0; zone < baths_count; zone++) {
+            char command[96];
+            snprintf(command,
+                     sizeof(command),
+                     "{\"zone\":%d,\"target_temperature\":%.2f,\"heater_state\":true}",
+                     zone,
+                     target);
+            char *response = NULL;
+            apply_command(command, &response);
+            free(response);
+        }
+    }
+
+    sim_httpd_set_port(port);
+    sim_httpd_set_max_open_sockets(max_open_sockets);
+    if (!setup_web_server()) {
+        return 1;
+    }
+
+    if (mqtt_interval_ms > 0) {
+        if (init_mqtt_bridge("mqtt://sim", mqtt_interval_ms) != ESP_OK) {
+            return 1;
+        }
+        set_state_change_cb(mqtt_bridge_on_state_change);
+    }
+
+    init_safety();
+
+    // ws_load waits for this line, every uri handler is registered by now and nothing else
+    // is printed before it
+    printf(SIM_READY_LINE " on port %d with %d zones\n", port, baths_count);
+    fflush(stdout);
+
+    start_tick = xTaskGetTickCount();
+
+    TaskHandle_t task_handle;
+    xTaskCreate((TaskFunction_t)bath_loop, "bath", 1024 * 4, NULL, tskIDLE_PRIORITY, &task_handle);
+    xTaskCreate((TaskFunction_t)temperature_read_loop,
+                "control loop",
+                1024 * 4,
+                temperature_read_cb,
+                tskIDLE_PRIORITY,
+                &task_handle);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // runs until a signal or, with --duration, until it expires
+    if (duration_s > 0) {
+        double wait_s = duration_s / time_scale;
+        struct timespec timeout = {.tv_sec = wait_s, .tv_nsec = (wait_s - (long)wait_s) * 1e9};
+        sigtimedwait(&signals, NULL, &timeout);
+    } else {
+        int received_signal;
+        sigwait(&signals, &received_signal);
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_stats((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    return 0;
+}
+
+// same as the device callback in main.c
+static void temperature_read_cb(const bool *p_updated) {
+    send_temperature_update(p_updated, FD_EVERYONE);
+
+    for (int zone = 0; zone < zones_count; zone++) {
+        if (!p_updated[zone]) {
+            continue;
+        }
+
+        safety_on_temperature_update(zone, current_temperature[zone]);
+        heater_on_temperature_update(zone);
+        mqtt_bridge_on_temperature_update(zone, current_temperature[zone]);
+    }
+}
+
+// <topic>=<payload>
+static bool parse_mqtt_message(const char *p_text, bool p_retain) {
+    const char *separator = strchr(p_text, '=');
+    if (!separator || separator == p_text) {
+        return false;
+    }
+
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%.*s", (int)(separator - p_text), p_text);
+    host_mqtt_publish(topic, separator + 1, p_retain);
+    return true;
+}
+
+// <zone>,<kind>,<value>,<at s>
+static bool parse_injection(const char *p_text, injection_t *p_injection) {
+    char kind[16];
+    double at_s;
+    if (sscanf(p_text,
+               "%d,%15[^,],%f,%lf",
+               &p_injection->zone,
+               kind,
+               &p_injection->value,
+               &at_s) != 4) {
+        return false;
+    }
+    p_injection->at_ms = at_s * 1000;
+
+    for (int i = 0; i < sizeof(inject_kind_names) / sizeof(*inject_kind_names); i++) {
+        if (!strcmp(kind, inject_kind_names[i])) {
+            p_injection->kind = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void bath_loop() {
+    TickType_t last_wake = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(BATH_STEP_MS));
+
+        for (int i = 0; i < injections_count; i++) {
+            if (!injections[i].done &&
+                pdTICKS_TO_MS(xTaskGetTickCount() - start_tick) >= injections[i].at_ms) {
+                inject(&injections[i]);
+            }
+        }
+
+        for (int zone = 0; zone < baths_count; zone++) {
+            bath_t *bath = &baths[zone];
+            float duty = host_ledc_get_duty(heaters[zone].channel) / (float)UINT16_MAX;
+            float power = bath->power_w * duty + bath->external_power_w -
+                          BATH_LOSS_W_PER_K * (bath->temperature - bath->ambient);
+            bath->temperature +=
+                power * (BATH_STEP_MS / 1000.f) / (bath->volume_l * WATER_HEAT_CAPACITY);
+
+            // a probe in air reads its surroundings, never exactly the same value twice
+            float noise = PROBE_OUT_NOISE * (rand() / (float)RAND_MAX - 0.5f);
+            host_ds18b20_set_temperature(
+                zone, bath->probe_out ? bath->probe_out_reading + noise : bath->temperature);
+        }
+    }
+}
+
+static void inject(injection_t *p_injection) {
+    p_injection->done = true;
+    bath_t *bath = &baths[p_injection->zone];
+
+    switch (p_injection->kind) {
+    case INJECT_READ_ERROR:
+        temperature_inject_fault(p_injection->zone, TEMPERATURE_FAULT_READ_ERROR, 0);
+        break;
+    case INJECT_STUCK:
+        temperature_inject_fault(p_injection->zone, TEMPERATURE_FAULT_STUCK, 0);
+        break;
+    case INJECT_OVERRIDE:
+        temperature_inject_fault(
+            p_injection->zone, TEMPERATURE_FAULT_OVERRIDE, p_injection->value);
+        break;
+    case INJECT_PROBE_OUT:
+        bath->probe_out = true;
+        bath->probe_out_reading = p_injection->value;
+        break;
+    case INJECT_DRY_RUN:
+        bath->volume_l = p_injection->value;
+        break;
+    case INJECT_EXTERNAL_HEAT:
+        bath->external_power_w = p_injection->value;
+        break;
+    }
+
+    // the bath faults happen outside the firmware, the supervisor still measures from here
+    temperature_fault_injected_tick[p_injection->zone] = xTaskGetTickCount();
+
+    printf("injected %s into zone %d\n",
+           inject_kind_names[p_injection->kind],
+           p_injection->zone);
+    fflush(stdout);
+}
+
+static void print_stats(double p_elapsed_s) {
+    sim_httpd_stats_t stats = sim_httpd_get_stats();
+    temperature_loop_stats_t loop = temperature_loop_stats;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+                   usage.ru_stime.tv_usec / 1e6;
+
+    long rss_kb = 0;
+    FILE *fp = fopen("/proc/self/status", "r");
+    char line[128];
+    while (fp && fgets(line, sizeof(line), fp)) {
+        sscanf(line, "VmRSS: %ld kB", &rss_kb);
+    }
+    if (fp) {
+        fclose(fp);
+    }
+
+    printf("sessions accepted %llu rejected %llu, work queued %llu dropped %llu, "
+           "frames sent %llu received %llu, rss %ld kB\n",
+           (unsigned long long)stats.sessions_accepted,
+           (unsigned long long)stats.sessions_rejected,
+           (unsigned long long)stats.work_queued,
+           (unsigned long long)stats.work_dropped,
+           (unsigned long long)stats.frames_sent,
+           (unsigned long long)stats.frames_received,
+           rss_kb);
+    printf("zones %d, control loop %u iterations, period last %.1f ms max %.1f ms, "
+           "work mean %.2f ms max %.2f ms, cpu %.2f%%\n",
+           baths_count,
+           loop.iterations,
+           loop.period_us / 1000.,
+           loop.max_period_us / 1000.,
+           loop.iterations ? loop.total_work_us / 1000. / loop.iterations : 0,
+           loop.max_work_us / 1000.,
+           p_elapsed_s > 0 ? 100 * cpu_s / p_elapsed_s : 0);
+    for (int zone = 0; zone < baths_count; zone++) {
+        printf("zone %d bath %.2f C, target %.1f C, fault %s",
+               zone,
+               baths[zone].temperature,
+               heaters[zone].target_temperature,
+               safety_fault_to_name(safety_fault[zone]));
+        if (safety_detection_latency_ms[zone]) {
+            printf(", detected %lu ms after injection",
+                   (unsigned long)safety_detection_latency_ms[zone]);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+// knobs and counters of the POSIX esp_http_server used by the simulator
+
+// first line sim prints on stdout once the web server takes requests
+#define SIM_READY_LINE "sim ready"
+
+struct {
+    uint64_t sessions_accepted;
+    uint64_t sessions_rejected; // no free session, max_open_sockets reached
+    uint64_t work_queued;
+    uint64_t work_dropped; // control queue full, the device drops these silently
+    uint64_t frames_sent;
+    uint64_t frames_received;
+} typedef sim_httpd_stats_t;
+
+// both override what the firmware passes to httpd_start, 0 keeps the firmware value
+void sim_httpd_set_port(uint16_t p_port);
+void sim_httpd_set_max_open_sockets(uint16_t p_max_open_sockets);
+
+sim_httpd_stats_t sim_httpd_get_stats();
@@ -0,0 +1,114 @@
+#include <ds18b20.h>
+#include <host_stubs.h>
+
+#include <stdatomic.h>
+#include <time.h>
+
+// one bus with up to MAX_PROBES probes whose readings are set by the host program
+
+#define MAX_PROBES 8
+#define FIRST_ADDRESS 0x28000000000000ffULL
+
+static struct host_onewire_bus {
+    int gpio;
+} bus;
+
+static struct host_onewire_iter {
+    int next;
+} iter;
+
+static struct host_ds18b20 {
+    int index;
+} devices[MAX_PROBES];
+
+static atomic_int probes_count = 1;
+static _Atomic float temperatures[MAX_PROBES];
+static atomic_uint_least32_t read_us = 0;
+
+void host_ds18b20_set_probes(int p_count) {
+    probes_count = p_count < MAX_PROBES ? p_count : MAX_PROBES;
+}
+
+void host_ds18b20_set_temperature(int p_probe, float p_temperature) {
+    temperatures[p_probe] = p_temperature;
+}
+
+void host_ds18b20_set_read_us(uint32_t p_read_us) {
+    read_us = p_read_us;
+}
+
+// the rmt driver blocks the caller for the whole transaction
+static void busy_bus(uint32_t p_us) {
+    host_sleep_us(p_us);
+}
+
+esp_err_t onewire_new_bus_rmt(const onewire_bus_config_t *bus_config,
+                              const onewire_bus_rmt_config_t *rmt_config,
+                              onewire_bus_handle_t *ret_bus) {
+    bus.gpio = bus_config->bus_gpio_num;
+    *ret_bus = &bus;
+    return ESP_OK;
+}
+
+esp_err_t onewire_new_device_iter(onewire_bus_handle_t bus, onewire_device_iter_handle_t *ret_iter) {
+    iter.next = 0;
+    *ret_iter = &iter;
+    return ESP_OK;
+}
+
+esp_err_t onewire_device_iter_get_next(onewire_device_iter_handle_t iter,
+                                       onewire_device_t *dev) {
+    if (iter->next >= probes_count) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    dev->bus = &bus;
+    dev->address = FIRST_ADDRESS + ((uint64_t)iter->next++ << 8);
+    return ESP_OK;
+}
+
+esp_err_t onewire_del_device_iter(onewire_device_iter_handle_t iter) {
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_reset(onewire_bus_handle_t bus) {
+    return probes_count > 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t bus,
+                                  const uint8_t *tx_data,
+                                  uint8_t tx_data_size) {
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_new_device(onewire_device_t *device_info,
+                             const ds18b20_config_t *config,
+                             ds18b20_device_handle_t *ret_ds18b20) {
+    int index = (device_info->address - FIRST_ADDRESS) >> 8;
+    devices[index].index = index;
+    *ret_ds18b20 = &devices[index];
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_del_device(ds18b20_device_handle_t ds18b20) {
+    return ds18b20 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ds18b20_set_resolution(ds18b20_device_handle_t ds18b20,
+                                 ds18b20_resolution_t resolution) {
+    return ds18b20 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ds18b20_trigger_temperature_conversion(ds18b20_device_handle_t ds18b20) {
+    return ds18b20 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ds18b20_get_temperature(ds18b20_device_handle_t ds18b20, float *p_temperature) {
+    if (!ds18b20) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    busy_bus(read_us);
+    *p_temperature = temperatures[ds18b20->index];
+    return ESP_OK;
+}
@@ -0,0 +1,65 @@
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <host_stubs.h>
+
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+static atomic_int log_level = ESP_LOG_INFO;
+
+void esp_restart(void) {
+    fprintf(stderr, "esp_restart called\n");
+    abort();
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    }
+
+    return "UNKNOWN ERROR";
+}
+
+// a locally administered address, the mqtt topics of the host build are sous-vide/000001
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+    const uint8_t host_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    memcpy(mac, host_mac, sizeof(host_mac));
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void) {
+    return host_time_us();
+}
+
+void esp_log_level_set(const char *p_tag, esp_log_level_t p_level) {
+    log_level = p_level;
+}
+
+esp_log_level_t esp_log_level_get(const char *p_tag) {
+    return log_level;
+}
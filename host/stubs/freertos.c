@@ -0,0 +1,228 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <host_stubs.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct host_task {
+    TaskFunction_t code;
+    void *parameters;
+    pthread_mutex_t notify_mutex;
+    pthread_cond_t notify_cond;
+    uint32_t notify_value;
+};
+
+struct host_semaphore {
+    pthread_mutex_t mutex;
+};
+
+static __thread struct host_task *current_task = NULL;
+
+static bool inline_tasks = false;
+// where vTaskDelete of an inline task returns to
+static __thread jmp_buf *inline_task_exit = NULL;
+
+void host_freertos_set_inline_tasks(bool p_inline) {
+    inline_tasks = p_inline;
+}
+
+static void run_inline(TaskFunction_t p_code, void *p_parameters) {
+    struct host_task task = {.code = p_code, .parameters = p_parameters};
+    struct host_task *caller_task = current_task;
+    jmp_buf *caller_exit = inline_task_exit;
+
+    jmp_buf exit;
+    current_task = &task;
+    inline_task_exit = &exit;
+    if (!setjmp(exit)) {
+        p_code(p_parameters);
+    }
+
+    current_task = caller_task;
+    inline_task_exit = caller_exit;
+}
+
+// simulated time runs time_scale times faster than the host clock from time_scale_start_ns on,
+// every delay, timeout and tick count goes through it
+static uint32_t time_scale = 1;
+static uint64_t time_scale_start_ns = 0;
+
+static uint64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void host_set_time_scale(uint32_t p_scale) {
+    time_scale_start_ns = monotonic_ns();
+    time_scale = p_scale ? p_scale : 1;
+}
+
+uint64_t host_time_us() {
+    uint64_t now = monotonic_ns();
+    return (time_scale_start_ns + (now - time_scale_start_ns) * time_scale) / 1000;
+}
+
+void host_sleep_us(uint64_t p_us) {
+    uint64_t ns = p_us * 1000 / time_scale;
+    struct timespec duration = {.tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000};
+    while (nanosleep(&duration, &duration) == -1 && errno == EINTR) {
+    }
+}
+
+static void *task_entry(void *p_task) {
+    current_task = p_task;
+    current_task->code(current_task->parameters);
+    return NULL;
+}
+
+static struct timespec deadline_after(TickType_t p_ticks) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = (uint64_t)pdTICKS_TO_MS(p_ticks) * 1000000 / time_scale + deadline.tv_nsec;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    return deadline;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode,
+                       const char *pcName,
+                       uint32_t usStackDepth,
+                       void *pvParameters,
+                       UBaseType_t uxPriority,
+                       TaskHandle_t *pxCreatedTask) {
+    // the handle of an inline task is gone by the time the caller could use it
+    if (inline_tasks) {
+        run_inline(pxTaskCode, pvParameters);
+        if (pxCreatedTask) {
+            *pxCreatedTask = NULL;
+        }
+        return pdPASS;
+    }
+
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+    if (!task) {
+        return pdFAIL;
+    }
+
+    task->code = pxTaskCode;
+    task->parameters = pvParameters;
+    pthread_mutex_init(&task->notify_mutex, NULL);
+    pthread_cond_init(&task->notify_cond, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    int ret = pthread_create(&thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        free(task);
+        return pdFAIL;
+    }
+
+    if (pxCreatedTask) {
+        *pxCreatedTask = task;
+    }
+
+    return pdPASS;
+}
+
+// only deleting the calling task is supported, which is all the firmware does
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+    if (xTaskToDelete != NULL && xTaskToDelete != current_task) {
+        fprintf(stderr, "vTaskDelete of another task is not supported on host\n");
+        abort();
+    }
+
+    if (inline_task_exit) {
+        longjmp(*inline_task_exit, 1);
+    }
+
+    // the handle may still be notified by others, it is intentionally leaked
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    host_sleep_us((uint64_t)pdTICKS_TO_MS(xTicksToDelay) * 1000);
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement) {
+    *pxPreviousWakeTime += xTimeIncrement;
+
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(*pxPreviousWakeTime - now) > 0) {
+        vTaskDelay(*pxPreviousWakeTime - now);
+    }
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(host_time_us() * configTICK_RATE_HZ / 1000000);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    pthread_mutex_lock(&xTaskToNotify->notify_mutex);
+    xTaskToNotify->notify_value++;
+    pthread_cond_signal(&xTaskToNotify->notify_cond);
+    pthread_mutex_unlock(&xTaskToNotify->notify_mutex);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    struct host_task *task = current_task;
+    struct timespec deadline = deadline_after(xTicksToWait);
+
+    pthread_mutex_lock(&task->notify_mutex);
+    while (task->notify_value == 0) {
+        if (xTicksToWait == portMAX_DELAY) {
+            pthread_cond_wait(&task->notify_cond, &task->notify_mutex);
+        } else if (pthread_cond_timedwait(&task->notify_cond, &task->notify_mutex, &deadline) ==
+                   ETIMEDOUT) {
+            break;
+        }
+    }
+
+    uint32_t value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = xClearCountOnExit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->notify_mutex);
+
+    return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    struct host_semaphore *semaphore = calloc(1, sizeof(struct host_semaphore));
+    if (!semaphore) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&semaphore->mutex, NULL);
+    return semaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore) {
+    pthread_mutex_destroy(&xSemaphore->mutex);
+    free(xSemaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime) {
+    if (xBlockTime == portMAX_DELAY) {
+        return pthread_mutex_lock(&xSemaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+    } else if (xBlockTime == 0) {
+        return pthread_mutex_trylock(&xSemaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+    }
+
+    struct timespec deadline = deadline_after(xBlockTime);
+    return pthread_mutex_timedlock(&xSemaphore->mutex, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+    return pthread_mutex_unlock(&xSemaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+}
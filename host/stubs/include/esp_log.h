@@ -0,0 +1,27 @@
+#pragma once
+#include <stdio.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+// the tag is ignored, the host build has a single global level
+void esp_log_level_set(const char *p_tag, esp_log_level_t p_level);
+esp_log_level_t esp_log_level_get(const char *p_tag);
+
+#define ESP_LOG_LEVEL_LOCAL(level, letter, tag, format, ...)                                       \
+    do {                                                                                           \
+        if (esp_log_level_get(tag) >= level) {                                                     \
+            fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__);                      \
+        }                                                                                          \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,30 @@
+#pragma once
+#include <driver/ledc.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// hooks into the stubbed peripherals, only exist in the host build
+
+// probes on the bus, the reading of each and how long reading one scratchpad blocks
+void host_ds18b20_set_probes(int p_count);
+void host_ds18b20_set_temperature(int p_probe, float p_temperature);
+void host_ds18b20_set_read_us(uint32_t p_read_us);
+
+// duty the firmware last latched with ledc_update_duty
+uint32_t host_ledc_get_duty(ledc_channel_t p_channel);
+
+// the mqtt client connects as soon as it is started and prints every publish on stderr,
+// p_retain keeps the message for every later subscribe like a broker, otherwise it is
+// delivered once on the client task
+void host_mqtt_publish(const char *p_topic, const char *p_data, bool p_retain);
+
+// simulated time runs p_scale times faster than the host clock, for the ticks, esp_timer and
+// every delay, so that minutes long safety windows can be checked in seconds
+void host_set_time_scale(uint32_t p_scale);
+uint64_t host_time_us();
+void host_sleep_us(uint64_t p_us);
+
+// xTaskCreate runs the task to completion on the calling thread, for tasks that end with
+// vTaskDelete and have to be deterministic, like the nvs commit in the benchmarks
+void host_freertos_set_inline_tasks(bool p_inline);
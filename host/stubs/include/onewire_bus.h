@@ -0,0 +1,32 @@
+#pragma once
+#include "esp_err.h"
+
+#include <stdint.h>
+
+typedef struct host_onewire_bus *onewire_bus_handle_t;
+typedef struct host_onewire_iter *onewire_device_iter_handle_t;
+
+typedef struct {
+    int bus_gpio_num;
+} onewire_bus_config_t;
+
+typedef struct {
+    uint32_t max_rx_bytes;
+} onewire_bus_rmt_config_t;
+
+typedef struct {
+    onewire_bus_handle_t bus;
+    uint64_t address;
+} onewire_device_t;
+
+esp_err_t onewire_new_bus_rmt(const onewire_bus_config_t *bus_config,
+                              const onewire_bus_rmt_config_t *rmt_config,
+                              onewire_bus_handle_t *ret_bus);
+esp_err_t onewire_new_device_iter(onewire_bus_handle_t bus, onewire_device_iter_handle_t *ret_iter);
+esp_err_t onewire_device_iter_get_next(onewire_device_iter_handle_t iter,
+                                       onewire_device_t *dev);
+esp_err_t onewire_del_device_iter(onewire_device_iter_handle_t iter);
+esp_err_t onewire_bus_reset(onewire_bus_handle_t bus);
+esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t bus,
+                                  const uint8_t *tx_data,
+                                  uint8_t tx_data_size);
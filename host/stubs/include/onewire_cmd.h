@@ -0,0 +1,3 @@
+#pragma once
+
+#define ONEWIRE_CMD_SKIP_ROM 0xCC
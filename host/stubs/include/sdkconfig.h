@@ -0,0 +1,8 @@
+#pragma once
+
+// values the firmware reads from the esp32 sdkconfig
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_LWIP_MAX_LISTENING_TCP 16
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 512
+#define CONFIG_LWIP_UDP_RECVMBOX_SIZE 6
+#define CONFIG_LWIP_TCP_SND_BUF_DEFAULT 5760
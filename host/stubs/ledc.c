@@ -0,0 +1,47 @@
+#include <driver/ledc.h>
+#include <host_stubs.h>
+
+#include <stdatomic.h>
+
+static atomic_uint_least32_t pending_duty[LEDC_CHANNEL_MAX];
+static atomic_uint_least32_t latched_duty[LEDC_CHANNEL_MAX];
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf) {
+    if (ledc_conf->channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pending_duty[ledc_conf->channel] = ledc_conf->duty;
+    latched_duty[ledc_conf->channel] = ledc_conf->duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+    if (channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pending_duty[channel] = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    if (channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    latched_duty[channel] = pending_duty[channel];
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    return latched_duty[channel];
+}
+
+uint32_t host_ledc_get_duty(ledc_channel_t p_channel) {
+    return latched_duty[p_channel];
+}
@@ -0,0 +1,182 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <host_stubs.h>
+#include <mqtt_client.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+// a broker in the same process for one client: the client connects as soon as it is started,
+// every publish is printed on stderr and the messages of the host program are delivered on the
+// client task, like the events of the esp-mqtt task
+
+#define MAX_MESSAGES 8
+#define MAX_TOPIC_LEN 64
+#define MAX_DATA_LEN 256
+#define CLIENT_POLL_MS 10
+
+struct {
+    char topic[MAX_TOPIC_LEN];
+    char data[MAX_DATA_LEN];
+    bool retain;
+} typedef host_mqtt_message_t;
+
+static struct esp_mqtt_client {
+    esp_event_handler_t handler;
+    void *handler_arg;
+} client;
+
+// guarded by messages_mutex
+static pthread_mutex_t messages_mutex = PTHREAD_MUTEX_INITIALIZER;
+static host_mqtt_message_t retained[MAX_MESSAGES];
+static int retained_count = 0;
+static host_mqtt_message_t pending[MAX_MESSAGES];
+static int pending_count = 0;
+static char subscription[MAX_TOPIC_LEN];
+static int msg_id = 0;
+
+static void client_loop();
+static void dispatch(esp_mqtt_event_id_t p_event_id, host_mqtt_message_t *p_message);
+static bool is_subscribed(const char *p_topic);
+static void add_message(host_mqtt_message_t *p_messages,
+                        int *p_count,
+                        const host_mqtt_message_t *p_message);
+
+void host_mqtt_publish(const char *p_topic, const char *p_data, bool p_retain) {
+    host_mqtt_message_t message = {.retain = p_retain};
+    snprintf(message.topic, sizeof(message.topic), "%s", p_topic);
+    snprintf(message.data, sizeof(message.data), "%s", p_data);
+
+    pthread_mutex_lock(&messages_mutex);
+    if (p_retain) {
+        add_message(retained, &retained_count, &message);
+    } else {
+        add_message(pending, &pending_count, &message);
+    }
+    pthread_mutex_unlock(&messages_mutex);
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+    return &client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client,
+                                         esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler,
+                                         void *event_handler_arg) {
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    TaskHandle_t task_handle;
+    if (xTaskCreate((TaskFunction_t)client_loop,
+                    "mqtt client",
+                    1024 * 4,
+                    NULL,
+                    tskIDLE_PRIORITY + 5,
+                    &task_handle) != pdPASS) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client,
+                            const char *topic,
+                            const char *data,
+                            int len,
+                            int qos,
+                            int retain,
+                            bool store) {
+    if (len == 0) {
+        len = strlen(data);
+    }
+
+    fprintf(stderr, "mqtt %s%s %.*s\n", topic, retain ? " (retained)" : "", len, data);
+
+    pthread_mutex_lock(&messages_mutex);
+    int id = ++msg_id;
+    pthread_mutex_unlock(&messages_mutex);
+    return id;
+}
+
+// retained messages go out to every new subscriber, like a broker does on a reconnect
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos) {
+    pthread_mutex_lock(&messages_mutex);
+    snprintf(subscription, sizeof(subscription), "%s", topic);
+    for (int i = 0; i < retained_count; i++) {
+        if (is_subscribed(retained[i].topic)) {
+            add_message(pending, &pending_count, &retained[i]);
+        }
+    }
+    int id = ++msg_id;
+    pthread_mutex_unlock(&messages_mutex);
+    return id;
+}
+
+static void client_loop() {
+    dispatch(MQTT_EVENT_CONNECTED, NULL);
+
+    while (true) {
+        pthread_mutex_lock(&messages_mutex);
+        host_mqtt_message_t messages[MAX_MESSAGES];
+        int count = 0;
+        for (int i = 0; i < pending_count; i++) {
+            if (is_subscribed(pending[i].topic)) {
+                messages[count++] = pending[i];
+            }
+        }
+        pending_count = 0;
+        pthread_mutex_unlock(&messages_mutex);
+
+        for (int i = 0; i < count; i++) {
+            dispatch(MQTT_EVENT_DATA, &messages[i]);
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(CLIENT_POLL_MS));
+    }
+}
+
+static void dispatch(esp_mqtt_event_id_t p_event_id, host_mqtt_message_t *p_message) {
+    esp_mqtt_event_t event = {.event_id = p_event_id, .client = &client};
+    if (p_message) {
+        event.topic = p_message->topic;
+        event.topic_len = strlen(p_message->topic);
+        event.data = p_message->data;
+        event.data_len = strlen(p_message->data);
+        event.total_data_len = event.data_len;
+        event.retain = p_message->retain;
+    }
+
+    client.handler(client.handler_arg, "MQTT_EVENTS", p_event_id, &event);
+}
+
+// caller holds messages_mutex, only "<prefix>/#" and exact filters are supported, "<prefix>/#"
+// matches <prefix> itself too
+static bool is_subscribed(const char *p_topic) {
+    int len = strlen(subscription);
+    if (len >= 2 && !strcmp(subscription + len - 2, "/#")) {
+        return !strncmp(p_topic, subscription, len - 2) &&
+               (p_topic[len - 2] == '\0' || p_topic[len - 2] == '/');
+    }
+
+    return len > 0 && !strcmp(p_topic, subscription);
+}
+
+// caller holds messages_mutex
+static void add_message(host_mqtt_message_t *p_messages,
+                        int *p_count,
+                        const host_mqtt_message_t *p_message) {
+    if (*p_count == MAX_MESSAGES) {
+        fprintf(stderr,
+                "mqtt message on %s dropped, %d are queued\n",
+                p_message->topic,
+                MAX_MESSAGES);
+        return;
+    }
+
+    p_messages[(*p_count)++] = *p_message;
+}
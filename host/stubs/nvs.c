@@ -0,0 +1,119 @@
+#include <nvs_flash.h>
+
+#include <pthread.h>
+#include <string.h>
+
+// in-memory namespaces, the handle is the namespace index + 1
+
+#define MAX_NAMESPACES 8
+#define MAX_ENTRIES 64
+#define MAX_KEY_LEN 16
+
+struct {
+    nvs_handle_t handle;
+    char key[MAX_KEY_LEN];
+    int32_t value;
+} typedef nvs_entry_t;
+
+static pthread_mutex_t entries_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char namespaces[MAX_NAMESPACES][MAX_KEY_LEN];
+static int namespaces_count = 0;
+static nvs_entry_t entries[MAX_ENTRIES];
+static int entries_count = 0;
+
+static nvs_entry_t *find_entry(nvs_handle_t p_handle, const char *p_key) {
+    for (int i = 0; i < entries_count; i++) {
+        if (entries[i].handle == p_handle && !strncmp(entries[i].key, p_key, MAX_KEY_LEN)) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static esp_err_t set_value(nvs_handle_t p_handle, const char *p_key, int32_t p_value) {
+    pthread_mutex_lock(&entries_mutex);
+
+    nvs_entry_t *entry = find_entry(p_handle, p_key);
+    if (!entry && entries_count < MAX_ENTRIES) {
+        entry = &entries[entries_count++];
+        entry->handle = p_handle;
+        strncpy(entry->key, p_key, MAX_KEY_LEN - 1);
+    }
+    if (entry) {
+        entry->value = p_value;
+    }
+
+    pthread_mutex_unlock(&entries_mutex);
+    return entry ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t get_value(nvs_handle_t p_handle, const char *p_key, int32_t *p_value) {
+    pthread_mutex_lock(&entries_mutex);
+
+    nvs_entry_t *entry = find_entry(p_handle, p_key);
+    if (entry) {
+        *p_value = entry->value;
+    }
+
+    pthread_mutex_unlock(&entries_mutex);
+    return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&entries_mutex);
+    entries_count = 0;
+    pthread_mutex_unlock(&entries_mutex);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    pthread_mutex_lock(&entries_mutex);
+
+    esp_err_t ret = ESP_OK;
+    int index = 0;
+    while (index < namespaces_count && strncmp(namespaces[index], namespace_name, MAX_KEY_LEN)) {
+        index++;
+    }
+    if (index == namespaces_count && namespaces_count < MAX_NAMESPACES) {
+        strncpy(namespaces[namespaces_count++], namespace_name, MAX_KEY_LEN - 1);
+    } else if (index == namespaces_count) {
+        ret = ESP_ERR_NO_MEM;
+    }
+    *out_handle = index + 1;
+
+    pthread_mutex_unlock(&entries_mutex);
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+esp_err_t nvs_set_i8(nvs_handle_t handle, const char *key, int8_t value) {
+    return set_value(handle, key, value);
+}
+
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char *key, int8_t *out_value) {
+    int32_t value;
+    esp_err_t ret = get_value(handle, key, &value);
+    if (ret == ESP_OK) {
+        *out_value = value;
+    }
+    return ret;
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value) {
+    return set_value(handle, key, value);
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value) {
+    return get_value(handle, key, out_value);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
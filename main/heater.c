@@ -2,6 +2,8 @@
 
 #include <esp_log.h>
 #include <driver/ledc.h>
+#include <math.h>
+#include <stdio.h>
 #include <temperature.h>
 
 #define TAG "heater"
@@ -11,20 +13,34 @@
 
 #define LED_PIN 2
 
-float target_temperature;
-bool heater_state;
+// zone 0 keeps the namespace of the single zone firmware so its saved configuration survives
+#define NVS_NAMESPACE "sous-vide"
+#define DEFAULT_HEATER_STATE false
+#define DEFAULT_TARGET_TEMPERATURE 50.f
+
+int zones_count = 0;
+heater_t heaters[MAX_ZONES];
 SemaphoreHandle_t configuration_mutex = NULL;
-nvs_handle_t sous_vide_nvs_handle;
 
-static int heater_pin;
 static SemaphoreHandle_t nvs_mutex = NULL;
+static SemaphoreHandle_t duty_mutex = NULL;
+static bool heater_tripped[MAX_ZONES];
+
+// guarded by nvs_mutex, one commit task writes every zone saved since it was started
+static bool nvs_dirty[MAX_ZONES];
+static bool nvs_commit_pending = false;
 
+static void load_heater_configuration_from_nvs(int p_zone);
 static void commit_heater_configuration_nvs();
-static void set_duty(uint16_t p_duty);
+static void set_duty(int p_zone, uint16_t p_duty);
 static float lerp(float a, float b, float t);
 
-void init_heater(int p_pin) {
-    heater_pin = p_pin;
+void init_heaters(const zone_config_t *p_zones, int p_count) {
+    if (p_count > MAX_ZONES) {
+        ESP_LOGE(TAG, "%d zones configured, only %d are supported", p_count, MAX_ZONES);
+        p_count = MAX_ZONES;
+    }
+    zones_count = p_count;
 
     // create mutexes
     {
@@ -39,11 +55,21 @@ void init_heater(int p_pin) {
             ESP_LOGE(TAG, "failed to create target_temperature_mutex");
             esp_restart();
         }
+
+        duty_mutex = xSemaphoreCreateMutex();
+        if (!duty_mutex) {
+            ESP_LOGE(TAG, "failed to create duty_mutex");
+            esp_restart();
+        }
+    }
+
+    for (int zone = 0; zone < zones_count; zone++) {
+        load_heater_configuration_from_nvs(zone);
     }
 
     // setup pwd
     {
-        // configure timer
+        // configure timer, shared by every zone
         ledc_timer_config_t timer_config = {.speed_mode = LEDC_LOW_SPEED_MODE,
                                             .duty_resolution = LEDC_TIMER_16_BIT,
                                             .timer_num = LEDC_TIMER_0,
@@ -61,47 +87,134 @@ void init_heater(int p_pin) {
                                                 .hpoint = 0};
         ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
 
-        channel_config.channel = LEDC_CHANNEL_1;
-        channel_config.gpio_num = heater_pin;
-        ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
+        for (int zone = 0; zone < zones_count; zone++) {
+            heaters[zone].channel = LEDC_CHANNEL_1 + zone;
+
+            channel_config.channel = heaters[zone].channel;
+            channel_config.gpio_num = p_zones[zone].heater_pin;
+            ESP_ERROR_CHECK(ledc_channel_config(&channel_config));
+        }
     }
 }
 
-void heater_on_temperature_update() {
+void heater_on_temperature_update(int p_zone) {
     if (xSemaphoreTake(configuration_mutex, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "failed to take target_temperature_mutex");
         esp_restart();
     }
 
+    const heater_t *heater = &heaters[p_zone];
+    float temperature = current_temperature[p_zone];
+    float target = heater->target_temperature;
+
     int duty = 0;
-    if (current_temperature < target_temperature && heater_state) { // target temperature reached
-        float difference = target_temperature - current_temperature;
+    if (temperature < target && heater->heater_state) { // target temperature reached
+        float difference = target - temperature;
         float t = MIN(1, difference / 5.f);
         float duty_f = lerp(0.1f, 0.6f, t);
         duty = UINT16_MAX * duty_f;
     }
 
     duty = MIN(duty, UINT16_MAX - 1);
-    ESP_LOGI(TAG, "new duty: %f", duty / (float)UINT16_MAX);
-
-    set_duty(duty);
 
     xSemaphoreGive(configuration_mutex);
+
+    if (xSemaphoreTake(duty_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take duty_mutex");
+        esp_restart();
+    }
+
+    if (heater_tripped[p_zone]) {
+        duty = 0;
+    }
+
+    ESP_LOGI(TAG, "zone %d new duty: %f", p_zone, duty / (float)UINT16_MAX);
+    set_duty(p_zone, duty);
+
+    xSemaphoreGive(duty_mutex);
+}
+
+// called by the safety supervisor, output stays at 0 until heater_reset_trip()
+void heater_force_off(int p_zone) {
+    if (xSemaphoreTake(duty_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take duty_mutex");
+        esp_restart();
+    }
+
+    heater_tripped[p_zone] = true;
+    set_duty(p_zone, 0);
+
+    xSemaphoreGive(duty_mutex);
+}
+
+void heater_reset_trip(int p_zone) {
+    if (xSemaphoreTake(duty_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take duty_mutex");
+        esp_restart();
+    }
+
+    heater_tripped[p_zone] = false;
+
+    xSemaphoreGive(duty_mutex);
 }
 
-void save_heater_configuration_to_nvs() {
+// caller holds configuration_mutex
+void save_heater_configuration_to_nvs(int p_zone) {
     if (xSemaphoreTake(nvs_mutex, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "failed to take nvs_mutex");
         esp_restart();
     }
 
-    nvs_set_i8(sous_vide_nvs_handle, "is_on", heater_state);
-    nvs_set_i32(sous_vide_nvs_handle, "targ_temp", *(int32_t *)&target_temperature);
+    heater_t *heater = &heaters[p_zone];
+    nvs_set_i8(heater->nvs_handle, "is_on", heater->heater_state);
+    nvs_set_i32(heater->nvs_handle, "targ_temp", *(int32_t *)&heater->target_temperature);
+
+    nvs_dirty[p_zone] = true;
+    bool start_commit = !nvs_commit_pending;
+    nvs_commit_pending = true;
 
     xSemaphoreGive(nvs_mutex);
 
-    TaskHandle_t task_handle;
-    xTaskCreate(commit_heater_configuration_nvs, "commit_cfg_nvs", 1024 * 3, NULL, 3, &task_handle);
+    if (start_commit) {
+        TaskHandle_t task_handle;
+        xTaskCreate(commit_heater_configuration_nvs,
+                    "commit_cfg_nvs",
+                    1024 * 3,
+                    NULL,
+                    3,
+                    &task_handle);
+    }
+}
+
+static void load_heater_configuration_from_nvs(int p_zone) {
+    char nvs_namespace[16] = NVS_NAMESPACE;
+    if (p_zone > 0) {
+        snprintf(nvs_namespace, sizeof(nvs_namespace), NVS_NAMESPACE "-%d", p_zone);
+    }
+
+    heater_t *heater = &heaters[p_zone];
+    esp_err_t ret = nvs_open(nvs_namespace, NVS_READWRITE, &heater->nvs_handle);
+    if (ret != ESP_OK) {
+        nvs_flash_erase();
+        esp_restart();
+    }
+
+    heater->heater_state = DEFAULT_HEATER_STATE;
+    heater->target_temperature = DEFAULT_TARGET_TEMPERATURE;
+
+    nvs_get_i8(heater->nvs_handle, "is_on", (int8_t *)&heater->heater_state);
+    nvs_get_i32(heater->nvs_handle, "targ_temp", (int32_t *)&heater->target_temperature);
+    // the same range apply_command accepts, anything else was not written by this firmware
+    if (isnanf(heater->target_temperature) ||
+        heater->target_temperature < MIN_TARGET_TEMPERATURE ||
+        heater->target_temperature > MAX_TARGET_TEMPERATURE) {
+        ESP_LOGW(TAG,
+                 "zone %d target temperature %f out of range, using %f",
+                 p_zone,
+                 heater->target_temperature,
+                 DEFAULT_TARGET_TEMPERATURE);
+        heater->target_temperature = DEFAULT_TARGET_TEMPERATURE;
+    }
 }
 
 static void commit_heater_configuration_nvs() {
@@ -110,19 +223,29 @@ static void commit_heater_configuration_nvs() {
         esp_restart();
     }
 
-    nvs_commit(sous_vide_nvs_handle);
+    for (int zone = 0; zone < zones_count; zone++) {
+        if (nvs_dirty[zone]) {
+            nvs_commit(heaters[zone].nvs_handle);
+            nvs_dirty[zone] = false;
+        }
+    }
+    nvs_commit_pending = false;
 
     xSemaphoreGive(nvs_mutex);
 
     vTaskDelete(0);
 }
 
-static void set_duty(uint16_t p_duty) {
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, p_duty);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+static void set_duty(int p_zone, uint16_t p_duty) {
+    heaters[p_zone].duty = p_duty;
+
+    if (p_zone == 0) {
+        ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, p_duty);
+        ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    }
 
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_1, p_duty);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_1);
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, heaters[p_zone].channel, p_duty);
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, heaters[p_zone].channel);
 }
 
 float lerp(float a, float b, float t) {
@@ -1,13 +1,29 @@
 #pragma once
+#include "zone.h"
+
+#include <driver/ledc.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <nvs_flash.h>
 
-extern float target_temperature;
-extern bool heater_state;
+#define MIN_TARGET_TEMPERATURE 0.f
+#define MAX_TARGET_TEMPERATURE 95.f
+
+struct {
+    // guarded by configuration_mutex
+    float target_temperature;
+    bool heater_state;
+
+    uint16_t duty;
+    ledc_channel_t channel;
+    nvs_handle_t nvs_handle;
+} typedef heater_t;
+
+extern heater_t heaters[MAX_ZONES];
 extern SemaphoreHandle_t configuration_mutex;
-extern nvs_handle_t sous_vide_nvs_handle;
 
-void init_heater(int p_pin);
-void heater_on_temperature_update();
-void save_heater_configuration_to_nvs();
+void init_heaters(const zone_config_t *p_zones, int p_count);
+void heater_on_temperature_update(int p_zone);
+void save_heater_configuration_to_nvs(int p_zone);
+void heater_force_off(int p_zone);
+void heater_reset_trip(int p_zone);
@@ -1,9 +1,11 @@
 #include "wifi.h"
 #include "heater.h"
+#include "mqtt_bridge.h"
+#include "safety.h"
 #include "temperature.h"
 #include "web_site.h"
+#include "zone.h"
 
-#include <math.h>
 #include <nvs_flash.h>
 #include <esp_log.h>
 
@@ -12,10 +14,19 @@
 #define WIFI_SSID "407"
 #define WIFI_PASSWORD "21090421"
 
-#define HEATER_PIN 14
+// empty disables the mqtt bridge, e.g. "mqtt://192.168.1.10"
+#define MQTT_BROKER_URI ""
+#define MQTT_PUBLISH_INTERVAL_MS 5000
+
+// every probe shares one bus, their addresses are logged at boot
 #define TEMPERATURE_SENSOR_PIN 23
 
-static void temperature_read_cb(float p_temperature);
+// one entry per bath, up to MAX_ZONES
+static const zone_config_t zones[] = {
+    {.heater_pin = 14, .probe_address = 0},
+};
+
+static void temperature_read_cb(const bool *p_updated);
 
 void app_main() {
     int ret;
@@ -27,32 +38,11 @@ void app_main() {
     }
     ESP_ERROR_CHECK(ret);
 
-    // load saved config
-    {
-        ret = nvs_open("sous-vide", NVS_READWRITE, &sous_vide_nvs_handle);
-        if (ret != ESP_OK) {
-            nvs_flash_erase();
-            esp_restart();
-        }
-
-        bool default_heater_state = false;
-        float default_target_temperature = 50;
-
-        heater_state = default_heater_state;
-        target_temperature = default_target_temperature;
-
-        nvs_get_i8(sous_vide_nvs_handle, "is_on", (int8_t *)&heater_state);
-        nvs_get_i32(sous_vide_nvs_handle, "targ_temp", (int32_t *)&target_temperature);
-        if (isnanf(target_temperature) || isinff(target_temperature)) {
-            target_temperature = default_target_temperature;
-        }
-    }
+    // load saved config of every zone and setup their heaters
+    init_heaters(zones, sizeof(zones) / sizeof(*zones));
 
-    //
-    init_heater(HEATER_PIN);
-    
     // init temperature
-    init_temperature_sensor(TEMPERATURE_SENSOR_PIN);
+    init_temperature_sensors(TEMPERATURE_SENSOR_PIN, zones, zones_count);
 
     // connect to wifi
     {
@@ -67,11 +57,25 @@ void app_main() {
     load_web_pages();
     setup_web_server();
 
-    // start temp read loop
+    // start mqtt bridge
+    if (MQTT_BROKER_URI[0] != '\0') {
+        ret = init_mqtt_bridge(MQTT_BROKER_URI, MQTT_PUBLISH_INTERVAL_MS);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "failed to start mqtt bridge");
+        } else {
+            // websocket commands and safety trips republish the state right away
+            set_state_change_cb(mqtt_bridge_on_state_change);
+        }
+    }
+
+    // start safety supervisor before anything can drive the heater
+    init_safety();
+
+    // start the control loop, it reads and controls every zone
     {
         TaskHandle_t temp_read_task;
         ret = xTaskCreate((TaskFunction_t)temperature_read_loop,
-                          "temp read loop",
+                          "control loop",
                           1024 * 4,
                           temperature_read_cb,
                           tskIDLE_PRIORITY,
@@ -82,7 +86,16 @@ void app_main() {
     }
 }
 
-static void temperature_read_cb(float p_temperature) {
-    send_temperature_update(p_temperature, FD_EVERYONE);
-    heater_on_temperature_update();
+static void temperature_read_cb(const bool *p_updated) {
+    send_temperature_update(p_updated, FD_EVERYONE);
+
+    for (int zone = 0; zone < zones_count; zone++) {
+        if (!p_updated[zone]) {
+            continue;
+        }
+
+        safety_on_temperature_update(zone, current_temperature[zone]);
+        heater_on_temperature_update(zone);
+        mqtt_bridge_on_temperature_update(zone, current_temperature[zone]);
+    }
 }
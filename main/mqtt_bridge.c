@@ -0,0 +1,414 @@
+#include "mqtt_bridge.h"
+#include "heater.h"
+#include "safety.h"
+#include "web_site.h"
+
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <mqtt_client.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAG "mqtt bridge"
+
+#define TOPIC_PREFIX "sous-vide"
+#define MAX_BATCH_SAMPLES 64
+#define MAX_COMMAND_LEN 256
+#define RECONNECT_TIMEOUT_MS 5000
+#define PUBLISH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+struct {
+    uint32_t uptime_ms;
+    uint8_t zone;
+    float temperature;
+    uint16_t duty;
+} typedef telemetry_sample_t;
+
+struct {
+    float target_temperature;
+    bool heater_state;
+    safety_fault_t fault;
+} typedef bridge_state_t;
+
+static esp_mqtt_client_handle_t client = NULL;
+static TaskHandle_t publish_task = NULL;
+static volatile bool connected = false;
+static volatile bool state_published = false;
+static volatile bool telemetry_due = false;
+static int publish_interval_ms;
+
+static char topic_base[32];
+static char status_topic[48];
+static char state_topic[48];
+static char telemetry_topic[48];
+static char command_topic[48];
+static char ack_topic[48];
+
+// ring buffer, the oldest samples are dropped while the broker is unreachable, while it is
+// connected a batch goes out early once the ring is half full, whatever the interval
+static SemaphoreHandle_t samples_mutex = NULL;
+static telemetry_sample_t samples[MAX_BATCH_SAMPLES];
+static int samples_start = 0;
+static int samples_count = 0;
+
+static bridge_state_t last_state[MAX_ZONES];
+
+static void publish_loop();
+static void publish_state();
+static void publish_telemetry();
+static void on_mqtt_event(void *p_arg, esp_event_base_t p_base, int32_t p_event_id, void *p_data);
+static void on_command(esp_mqtt_event_handle_t p_event);
+static bool is_topic(const char *p_topic, int p_len, const char *p_expected);
+static bool parse_zone_topic(const char *p_topic, int p_len, const char *p_name, int *p_zone);
+
+esp_err_t init_mqtt_bridge(const char *p_broker_uri, int p_publish_interval_ms) {
+    publish_interval_ms = p_publish_interval_ms;
+
+    uint8_t mac[6];
+    esp_err_t ret = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "esp_read_mac failed with %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    snprintf(topic_base,
+             sizeof(topic_base),
+             TOPIC_PREFIX "/%02x%02x%02x",
+             mac[3],
+             mac[4],
+             mac[5]);
+    snprintf(status_topic, sizeof(status_topic), "%s/status", topic_base);
+    snprintf(state_topic, sizeof(state_topic), "%s/state", topic_base);
+    snprintf(telemetry_topic, sizeof(telemetry_topic), "%s/telemetry", topic_base);
+    snprintf(command_topic, sizeof(command_topic), "%s/set/#", topic_base);
+    snprintf(ack_topic, sizeof(ack_topic), "%s/ack", topic_base);
+
+    samples_mutex = xSemaphoreCreateMutex();
+    if (!samples_mutex) {
+        ESP_LOGE(TAG, "failed to create samples_mutex");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // the client reconnects on its own task, nothing here waits for the broker
+    esp_mqtt_client_config_t config = {
+        .broker.address.uri = p_broker_uri,
+        .network.reconnect_timeout_ms = RECONNECT_TIMEOUT_MS,
+        .session.last_will = {.topic = status_topic, .msg = "offline", .qos = 1, .retain = 1},
+    };
+
+    client = esp_mqtt_client_init(&config);
+    if (!client) {
+        ESP_LOGE(TAG, "esp_mqtt_client_init failed");
+        return ESP_FAIL;
+    }
+
+    ret = esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, on_mqtt_event, NULL);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "esp_mqtt_client_register_event failed with %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    if (xTaskCreate(publish_loop,
+                    "mqtt publish",
+                    1024 * 4,
+                    NULL,
+                    PUBLISH_TASK_PRIORITY,
+                    &publish_task) != pdPASS) {
+        ESP_LOGE(TAG, "failed to create mqtt publish task");
+        return ESP_FAIL;
+    }
+
+    ret = esp_mqtt_client_start(client);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "esp_mqtt_client_start failed with %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "publishing to %s every %d ms", topic_base, publish_interval_ms);
+
+    return ESP_OK;
+}
+
+void mqtt_bridge_on_temperature_update(int p_zone, float p_temperature) {
+    if (!samples_mutex) {
+        return;
+    }
+
+    if (xSemaphoreTake(samples_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take samples_mutex");
+        esp_restart();
+    }
+
+    if (samples_count == MAX_BATCH_SAMPLES) {
+        samples_start = (samples_start + 1) % MAX_BATCH_SAMPLES;
+        samples_count--;
+    }
+
+    telemetry_sample_t *sample = &samples[(samples_start + samples_count) % MAX_BATCH_SAMPLES];
+    sample->uptime_ms = esp_timer_get_time() / 1000;
+    sample->zone = p_zone;
+    sample->temperature = p_temperature;
+    sample->duty = heaters[p_zone].duty;
+    samples_count++;
+
+    bool flush = connected && !telemetry_due && samples_count >= MAX_BATCH_SAMPLES / 2;
+    if (flush) {
+        telemetry_due = true;
+    }
+
+    xSemaphoreGive(samples_mutex);
+
+    if (flush) {
+        xTaskNotifyGive(publish_task);
+    }
+}
+
+// wakes the publish task, the retained state goes out without waiting for the interval
+void mqtt_bridge_on_state_change() {
+    if (publish_task) {
+        xTaskNotifyGive(publish_task);
+    }
+}
+
+// state goes out as soon as it changes, telemetry is batched per interval
+static void publish_loop() {
+    TickType_t last_telemetry_tick = xTaskGetTickCount();
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(publish_interval_ms));
+        if (!connected) {
+            continue;
+        }
+
+        publish_state();
+
+        TickType_t now = xTaskGetTickCount();
+        if (telemetry_due || now - last_telemetry_tick >= pdMS_TO_TICKS(publish_interval_ms)) {
+            last_telemetry_tick = now;
+            publish_telemetry();
+        }
+    }
+}
+
+static void publish_state() {
+    if (xSemaphoreTake(configuration_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take target_temperature_mutex");
+        esp_restart();
+    }
+
+    bridge_state_t state[MAX_ZONES];
+    for (int zone = 0; zone < zones_count; zone++) {
+        state[zone] = (bridge_state_t){.target_temperature = heaters[zone].target_temperature,
+                                       .heater_state = heaters[zone].heater_state,
+                                       .fault = safety_fault[zone]};
+    }
+
+    xSemaphoreGive(configuration_mutex);
+
+    bool changed = !state_published;
+    for (int zone = 0; zone < zones_count; zone++) {
+        changed |= state[zone].target_temperature != last_state[zone].target_temperature ||
+                   state[zone].heater_state != last_state[zone].heater_state ||
+                   state[zone].fault != last_state[zone].fault;
+    }
+    if (!changed) {
+        return;
+    }
+
+    // every zone in one retained message, so a subscriber never sees a partial state
+    char payload[MAX_ZONES * 96 + 16];
+    int len = snprintf(payload, sizeof(payload), "{\"zones\":[");
+    for (int zone = 0; zone < zones_count && len < sizeof(payload); zone++) {
+        len += snprintf(payload + len,
+                        sizeof(payload) - len,
+                        "%s{\"zone\":%d,\"target_temperature\":%f,\"heater_state\":%s,"
+                        "\"fault\":\"%s\"}",
+                        zone ? "," : "",
+                        zone,
+                        state[zone].target_temperature,
+                        state[zone].heater_state ? "true" : "false",
+                        safety_fault_to_name(state[zone].fault));
+    }
+    if (len < sizeof(payload)) {
+        len += snprintf(payload + len, sizeof(payload) - len, "]}");
+    }
+    if (len >= sizeof(payload)) {
+        ESP_LOGE(TAG, "state does not fit in %d bytes", (int)sizeof(payload));
+        return;
+    }
+
+    if (esp_mqtt_client_enqueue(client, state_topic, payload, len, 1, 1, true) < 0) {
+        ESP_LOGW(TAG, "failed to enqueue state");
+        return;
+    }
+
+    memcpy(last_state, state, sizeof(state));
+    state_published = true;
+}
+
+static void publish_telemetry() {
+    static telemetry_sample_t batch[MAX_BATCH_SAMPLES];
+    static char payload[MAX_BATCH_SAMPLES * 44 + 32];
+
+    if (xSemaphoreTake(samples_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take samples_mutex");
+        esp_restart();
+    }
+
+    int count = samples_count;
+    for (int i = 0; i < count; i++) {
+        batch[i] = samples[(samples_start + i) % MAX_BATCH_SAMPLES];
+    }
+    samples_start = 0;
+    samples_count = 0;
+    telemetry_due = false;
+
+    xSemaphoreGive(samples_mutex);
+
+    if (count == 0) {
+        return;
+    }
+
+    // [uptime_ms, zone, temperature, duty] per sample to keep the payload small
+    int len = snprintf(payload, sizeof(payload), "{\"samples\":[");
+    for (int i = 0; i < count && len < sizeof(payload); i++) {
+        len += snprintf(payload + len,
+                        sizeof(payload) - len,
+                        "%s[%lu,%d,%.2f,%.3f]",
+                        i ? "," : "",
+                        (unsigned long)batch[i].uptime_ms,
+                        batch[i].zone,
+                        batch[i].temperature,
+                        batch[i].duty / (float)UINT16_MAX);
+    }
+    if (len < sizeof(payload)) {
+        len += snprintf(payload + len, sizeof(payload) - len, "]}");
+    }
+    if (len >= sizeof(payload)) {
+        ESP_LOGE(TAG, "%d samples do not fit in %d bytes", count, (int)sizeof(payload));
+        return;
+    }
+
+    if (esp_mqtt_client_enqueue(client, telemetry_topic, payload, len, 0, 0, true) < 0) {
+        ESP_LOGW(TAG, "failed to enqueue %d samples", count);
+    }
+}
+
+static void on_mqtt_event(void *p_arg, esp_event_base_t p_base, int32_t p_event_id, void *p_data) {
+    esp_mqtt_event_handle_t event = p_data;
+
+    switch ((esp_mqtt_event_id_t)p_event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "connected");
+        esp_mqtt_client_enqueue(client, status_topic, "online", 0, 1, 1, true);
+        esp_mqtt_client_subscribe(client, command_topic, 1);
+        state_published = false;
+        connected = true;
+        xTaskNotifyGive(publish_task);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGI(TAG, "disconnected");
+        connected = false;
+        break;
+    case MQTT_EVENT_DATA:
+        on_command(event);
+        break;
+    default:
+        break;
+    }
+}
+
+static void on_command(esp_mqtt_event_handle_t p_event) {
+    // the broker hands a retained command out again on every reconnect, where it would undo
+    // whatever was changed over the websocket in between
+    if (p_event->retain) {
+        ESP_LOGW(TAG, "retained command on %.*s ignored", p_event->topic_len, p_event->topic);
+        return;
+    }
+
+    if (p_event->total_data_len != p_event->data_len || p_event->data_len >= MAX_COMMAND_LEN) {
+        ESP_LOGE(TAG, "command too long");
+        return;
+    }
+
+    char data[MAX_COMMAND_LEN];
+    memcpy(data, p_event->data, p_event->data_len);
+    data[p_event->data_len] = '\0';
+
+    // everything below "<base>/set" is a shorthand for a websocket message
+    int base_len = strlen(topic_base);
+    if (p_event->topic_len <= base_len || strncmp(p_event->topic, topic_base, base_len)) {
+        return;
+    }
+    const char *topic = p_event->topic + base_len;
+    int topic_len = p_event->topic_len - base_len;
+
+    char message[MAX_COMMAND_LEN + 32];
+    int zone;
+    if (is_topic(topic, topic_len, "/set")) {
+        snprintf(message, sizeof(message), "%s", data);
+    } else if (parse_zone_topic(topic, topic_len, "setpoint", &zone)) {
+        char *end;
+        float setpoint = strtof(data, &end);
+        if (end == data || *end != '\0') {
+            ESP_LOGE(TAG, "invalid setpoint \"%s\"", data);
+            return;
+        }
+        snprintf(message,
+                 sizeof(message),
+                 "{\"zone\":%d,\"target_temperature\":%f}",
+                 zone,
+                 setpoint);
+    } else if (parse_zone_topic(topic, topic_len, "power", &zone)) {
+        bool on = !strcmp(data, "on") || !strcmp(data, "true") || !strcmp(data, "1");
+        bool off = !strcmp(data, "off") || !strcmp(data, "false") || !strcmp(data, "0");
+        if (!on && !off) {
+            ESP_LOGE(TAG, "invalid power \"%s\"", data);
+            return;
+        }
+        snprintf(message,
+                 sizeof(message),
+                 "{\"zone\":%d,\"heater_state\":%s}",
+                 zone,
+                 on ? "true" : "false");
+    } else {
+        ESP_LOGE(TAG, "unknown command topic %.*s", p_event->topic_len, p_event->topic);
+        return;
+    }
+
+    // a change reaches the publish task through the state broadcast, like websocket commands
+    char *response = NULL;
+    apply_command(message, &response);
+    esp_mqtt_client_enqueue(client, ack_topic, response, 0, 1, 0, true);
+    free(response);
+}
+
+static bool is_topic(const char *p_topic, int p_len, const char *p_expected) {
+    return p_len == strlen(p_expected) && !strncmp(p_topic, p_expected, p_len);
+}
+
+// "/set/<p_name>" addresses zone 0, "/set/<zone>/<p_name>" any zone
+static bool parse_zone_topic(const char *p_topic, int p_len, const char *p_name, int *p_zone) {
+    char topic[64];
+    if (p_len >= sizeof(topic)) {
+        return false;
+    }
+    memcpy(topic, p_topic, p_len);
+    topic[p_len] = '\0';
+
+    char format[32];
+    snprintf(format, sizeof(format), "/set/%s", p_name);
+    if (!strcmp(topic, format)) {
+        *p_zone = 0;
+        return true;
+    }
+
+    // the zone itself is validated by apply_command
+    int consumed = 0;
+    snprintf(format, sizeof(format), "/set/%%d/%s%%n", p_name);
+    return sscanf(topic, format, p_zone, &consumed) == 1 && consumed == p_len;
+}
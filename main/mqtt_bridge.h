@@ -0,0 +1,6 @@
+#pragma once
+#include <esp_err.h>
+
+esp_err_t init_mqtt_bridge(const char *p_broker_uri, int p_publish_interval_ms);
+void mqtt_bridge_on_temperature_update(int p_zone, float p_temperature);
+void mqtt_bridge_on_state_change();
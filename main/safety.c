@@ -0,0 +1,287 @@
+#include "safety.h"
+#include "heater.h"
+#include "temperature.h"
+#include "web_site.h"
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#define TAG "safety"
+
+// above httpd, lwip and wifi so networking can never delay a trip
+#define SAFETY_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+// worst case trip latency is one check period plus one 250ms ledc period
+#define SAFETY_CHECK_PERIOD_MS 100
+
+#define SAFETY_STALE_TIMEOUT_MS 5000
+#define SAFETY_MIN_TEMPERATURE -10.f
+#define SAFETY_MAX_TEMPERATURE 105.f
+#define SAFETY_STUCK_TIMEOUT_MS (10 * 60 * 1000)
+#define SAFETY_NO_RESPONSE_DUTY (UINT16_MAX / 2)
+#define SAFETY_NO_RESPONSE_WINDOW_MS (10 * 60 * 1000)
+#define SAFETY_NO_RESPONSE_RISE 0.5f
+#define SAFETY_DRY_RUN_WINDOW_MS (30 * 1000)
+#define SAFETY_DRY_RUN_RISE 5.f
+#define SAFETY_RUNAWAY_WINDOW_MS (60 * 1000)
+#define SAFETY_RUNAWAY_RISE 1.f
+
+struct {
+    float temperature;
+    uint16_t duty; // duty the heater was driven with while this sample was measured
+    TickType_t tick;
+} typedef safety_sample_t;
+
+// guarded by sample_mutex
+struct {
+    safety_sample_t last_sample;
+    uint32_t last_sample_seq;
+    uint32_t checked_sample_seq;
+    bool have_references;
+
+    safety_sample_t stuck_ref;
+    safety_sample_t no_response_ref;
+    safety_sample_t dry_run_ref;
+    safety_sample_t runaway_ref;
+} typedef safety_zone_t;
+
+safety_fault_t safety_fault[MAX_ZONES];
+uint32_t safety_detection_latency_ms[MAX_ZONES];
+
+static SemaphoreHandle_t sample_mutex = NULL;
+static safety_zone_t zones[MAX_ZONES];
+
+static void safety_loop();
+static safety_fault_t check_sample(safety_zone_t *p_zone, const safety_sample_t *p_sample);
+static void trip(int p_zone, safety_fault_t p_fault);
+static void switch_off_tripped(const bool *p_tripped);
+static uint32_t elapsed_ms(const safety_sample_t *p_from, const safety_sample_t *p_to);
+
+void init_safety() {
+    sample_mutex = xSemaphoreCreateMutex();
+    if (!sample_mutex) {
+        ESP_LOGE(TAG, "failed to create sample_mutex");
+        esp_restart();
+    }
+
+    // give every sensor one stale timeout to deliver the first reading
+    for (int zone = 0; zone < zones_count; zone++) {
+        zones[zone].last_sample.tick = xTaskGetTickCount();
+    }
+
+    TaskHandle_t task_handle;
+    int ret = xTaskCreate(
+        safety_loop, "safety loop", 1024 * 3, NULL, SAFETY_TASK_PRIORITY, &task_handle);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "failed to create safety loop task");
+        esp_restart();
+    }
+}
+
+void safety_on_temperature_update(int p_zone, float p_temperature) {
+    if (xSemaphoreTake(sample_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take sample_mutex");
+        esp_restart();
+    }
+
+    safety_zone_t *zone = &zones[p_zone];
+    zone->last_sample.temperature = p_temperature;
+    zone->last_sample.duty = heaters[p_zone].duty;
+    zone->last_sample.tick = xTaskGetTickCount();
+    zone->last_sample_seq++;
+
+    xSemaphoreGive(sample_mutex);
+}
+
+// re-arms the heater, a fault that is still present trips again on the next check
+void safety_clear_fault(int p_zone) {
+    if (safety_fault[p_zone] == SAFETY_FAULT_NONE) {
+        return;
+    }
+
+    if (xSemaphoreTake(sample_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take sample_mutex");
+        esp_restart();
+    }
+
+    zones[p_zone].have_references = false;
+    zones[p_zone].last_sample.tick = xTaskGetTickCount();
+    safety_fault[p_zone] = SAFETY_FAULT_NONE;
+    heater_reset_trip(p_zone);
+
+    xSemaphoreGive(sample_mutex);
+
+    ESP_LOGI(TAG, "zone %d fault cleared", p_zone);
+    send_fault_update(p_zone, FD_EVERYONE);
+}
+
+const char *safety_fault_to_name(safety_fault_t p_fault) {
+    switch (p_fault) {
+    case SAFETY_FAULT_NONE:
+        return "none";
+    case SAFETY_FAULT_STALE:
+        return "sensor_stale";
+    case SAFETY_FAULT_IMPLAUSIBLE:
+        return "sensor_implausible";
+    case SAFETY_FAULT_STUCK:
+        return "sensor_stuck";
+    case SAFETY_FAULT_NO_RESPONSE:
+        return "no_response";
+    case SAFETY_FAULT_DRY_RUN:
+        return "dry_run";
+    case SAFETY_FAULT_RUNAWAY:
+        return "runaway";
+    }
+
+    return "unknown";
+}
+
+static void safety_loop() {
+    TickType_t last_wake = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SAFETY_CHECK_PERIOD_MS));
+
+        if (xSemaphoreTake(sample_mutex, portMAX_DELAY) != pdTRUE) {
+            ESP_LOGE(TAG, "failed to take sample_mutex");
+            esp_restart();
+        }
+
+        bool tripped[MAX_ZONES] = {0};
+        for (int i = 0; i < zones_count; i++) {
+            safety_zone_t *zone = &zones[i];
+            if (safety_fault[i] != SAFETY_FAULT_NONE) {
+                continue;
+            }
+
+            safety_fault_t fault = SAFETY_FAULT_NONE;
+            if (pdTICKS_TO_MS(xTaskGetTickCount() - zone->last_sample.tick) >
+                SAFETY_STALE_TIMEOUT_MS) {
+                fault = SAFETY_FAULT_STALE;
+            } else if (zone->checked_sample_seq != zone->last_sample_seq) {
+                zone->checked_sample_seq = zone->last_sample_seq;
+                fault = check_sample(zone, &zone->last_sample);
+            }
+
+            if (fault != SAFETY_FAULT_NONE) {
+                trip(i, fault);
+                tripped[i] = true;
+            }
+        }
+
+        xSemaphoreGive(sample_mutex);
+
+        for (int i = 0; i < zones_count; i++) {
+            if (tripped[i]) {
+                send_fault_update(i, FD_EVERYONE);
+            }
+        }
+
+        switch_off_tripped(tripped);
+    }
+}
+
+// the heater is switched off like a user would, so the trip survives a reboot and only
+// switching it on again re-arms the zone
+static void switch_off_tripped(const bool *p_tripped) {
+    if (xSemaphoreTake(configuration_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "failed to take target_temperature_mutex");
+        esp_restart();
+    }
+
+    bool changed[MAX_ZONES] = {0};
+    bool any_changed = false;
+    for (int zone = 0; zone < zones_count; zone++) {
+        if (p_tripped[zone] && heaters[zone].heater_state) {
+            heaters[zone].heater_state = false;
+            save_heater_configuration_to_nvs(zone);
+            changed[zone] = true;
+            any_changed = true;
+        }
+    }
+
+    if (any_changed) {
+        send_state_update(changed, FD_EVERYONE);
+    }
+
+    xSemaphoreGive(configuration_mutex);
+}
+
+static safety_fault_t check_sample(safety_zone_t *p_zone, const safety_sample_t *p_sample) {
+    if (p_sample->temperature < SAFETY_MIN_TEMPERATURE ||
+        p_sample->temperature > SAFETY_MAX_TEMPERATURE) {
+        return SAFETY_FAULT_IMPLAUSIBLE;
+    }
+
+    if (!p_zone->have_references) {
+        p_zone->stuck_ref = *p_sample;
+        p_zone->no_response_ref = *p_sample;
+        p_zone->dry_run_ref = *p_sample;
+        p_zone->runaway_ref = *p_sample;
+        p_zone->have_references = true;
+        return SAFETY_FAULT_NONE;
+    }
+
+    bool heating = p_sample->duty > 0;
+
+    // every window below restarts whenever its heater condition is broken
+
+    // a settled controller holds a low duty at a constant reading, only driving hard counts
+    if (p_sample->duty < SAFETY_NO_RESPONSE_DUTY ||
+        p_sample->temperature != p_zone->stuck_ref.temperature) {
+        p_zone->stuck_ref = *p_sample;
+    } else if (elapsed_ms(&p_zone->stuck_ref, p_sample) > SAFETY_STUCK_TIMEOUT_MS) {
+        return SAFETY_FAULT_STUCK;
+    }
+
+    if (p_sample->duty < SAFETY_NO_RESPONSE_DUTY) {
+        p_zone->no_response_ref = *p_sample;
+    } else if (elapsed_ms(&p_zone->no_response_ref, p_sample) > SAFETY_NO_RESPONSE_WINDOW_MS) {
+        if (p_sample->temperature - p_zone->no_response_ref.temperature < SAFETY_NO_RESPONSE_RISE) {
+            return SAFETY_FAULT_NO_RESPONSE;
+        }
+        p_zone->no_response_ref = *p_sample;
+    }
+
+    if (!heating) {
+        p_zone->dry_run_ref = *p_sample;
+    } else if (p_sample->temperature - p_zone->dry_run_ref.temperature > SAFETY_DRY_RUN_RISE) {
+        return SAFETY_FAULT_DRY_RUN;
+    } else if (elapsed_ms(&p_zone->dry_run_ref, p_sample) > SAFETY_DRY_RUN_WINDOW_MS) {
+        p_zone->dry_run_ref = *p_sample;
+    }
+
+    if (heating) {
+        p_zone->runaway_ref = *p_sample;
+    } else if (p_sample->temperature - p_zone->runaway_ref.temperature > SAFETY_RUNAWAY_RISE) {
+        return SAFETY_FAULT_RUNAWAY;
+    } else if (elapsed_ms(&p_zone->runaway_ref, p_sample) > SAFETY_RUNAWAY_WINDOW_MS) {
+        p_zone->runaway_ref = *p_sample;
+    }
+
+    return SAFETY_FAULT_NONE;
+}
+
+static void trip(int p_zone, safety_fault_t p_fault) {
+    heater_force_off(p_zone);
+    safety_fault[p_zone] = p_fault;
+
+    if (temperature_fault_injected_tick[p_zone] != 0) {
+        safety_detection_latency_ms[p_zone] =
+            pdTICKS_TO_MS(xTaskGetTickCount() - temperature_fault_injected_tick[p_zone]);
+        ESP_LOGE(TAG,
+                 "zone %d fault %s, detected %lu ms after injection",
+                 p_zone,
+                 safety_fault_to_name(p_fault),
+                 (unsigned long)safety_detection_latency_ms[p_zone]);
+    } else {
+        ESP_LOGE(TAG,
+                 "zone %d fault %s, heater forced off",
+                 p_zone,
+                 safety_fault_to_name(p_fault));
+    }
+}
+
+static uint32_t elapsed_ms(const safety_sample_t *p_from, const safety_sample_t *p_to) {
+    return pdTICKS_TO_MS(p_to->tick - p_from->tick);
+}
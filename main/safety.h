@@ -0,0 +1,29 @@
+#pragma once
+#include "zone.h"
+
+#include <stdint.h>
+
+// 1 accepts "inject_fault" messages on the websocket, set with
+// idf.py -DSAFETY_FAULT_INJECTION=1 build, the host simulator is always built with it
+#ifndef SAFETY_FAULT_INJECTION
+#define SAFETY_FAULT_INJECTION 0
+#endif
+
+typedef enum {
+    SAFETY_FAULT_NONE,
+    SAFETY_FAULT_STALE,       // no successful sensor read for too long
+    SAFETY_FAULT_IMPLAUSIBLE, // reading outside of what a water bath can be
+    SAFETY_FAULT_STUCK,       // reading does not change while heating hard
+    SAFETY_FAULT_NO_RESPONSE, // heating hard but temperature does not rise, probe out of water
+    SAFETY_FAULT_DRY_RUN,     // temperature rises too fast while heating, not enough water
+    SAFETY_FAULT_RUNAWAY,     // temperature rises while the heater is off
+} safety_fault_t;
+
+extern safety_fault_t safety_fault[MAX_ZONES];
+// time from an injected fault to its trip, 0 until one trips
+extern uint32_t safety_detection_latency_ms[MAX_ZONES];
+
+void init_safety();
+void safety_on_temperature_update(int p_zone, float p_temperature);
+void safety_clear_fault(int p_zone);
+const char *safety_fault_to_name(safety_fault_t p_fault);
@@ -1,20 +1,48 @@
 #include "temperature.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <onewire_bus.h>
+#include <onewire_cmd.h>
 #include <ds18b20.h>
 
 #define TAG "temperature"
 
-static ds18b20_device_handle_t thermometer_device;
-static onewire_device_t next_onewire_device;
+#define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
 
-float current_temperature;
+#define MAX_PROBES 8
+#define READ_ATTEMPTS 3
+#define READ_RETRY_DELAY_MS 50
+
+// every probe converts at once, so adding zones only adds their scratchpad reads
+#define CONTROL_PERIOD_MS 1000
+#define CONVERSION_MS 750 // 12 bit resolution
+
+// the ds18b20 component keeps its function commands private
+#define DS18B20_CMD_CONVERT_TEMP 0x44
+
+struct {
+    ds18b20_device_handle_t device;
+    temperature_fault_t injected_fault;
+    float injected_value;
+} typedef probe_t;
+
+static onewire_bus_handle_t bus;
+static probe_t probes[MAX_ZONES];
+static int probes_count = 0;
+
+float current_temperature[MAX_ZONES];
+TickType_t temperature_fault_injected_tick[MAX_ZONES];
+temperature_loop_stats_t temperature_loop_stats;
+
+static esp_err_t trigger_conversion();
+static esp_err_t read_temperature(int p_zone, float *p_temperature);
+
+void init_temperature_sensors(int p_pin, const zone_config_t *p_zones, int p_count) {
+    probes_count = p_count < MAX_ZONES ? p_count : MAX_ZONES;
 
-void init_temperature_sensor(int p_pin) {
-    onewire_bus_handle_t bus;
     onewire_bus_config_t bus_config = {
         .bus_gpio_num = p_pin,
     };
@@ -24,19 +52,26 @@ void init_temperature_sensor(int p_pin) {
 
     ESP_ERROR_CHECK(onewire_new_bus_rmt(&bus_config, &rmt_config, &bus));
 
+    ds18b20_device_handle_t found_devices[MAX_PROBES];
+    uint64_t found_addresses[MAX_PROBES];
+    bool claimed[MAX_PROBES] = {0};
+    int found_count = 0;
+
     onewire_device_iter_handle_t iter = NULL;
-    esp_err_t search_result = ESP_OK;
+    onewire_device_t next_onewire_device;
 
     ESP_ERROR_CHECK(onewire_new_device_iter(bus, &iter));
     ESP_LOGI(TAG, "Device iterator created, start searching...");
 
-    search_result = onewire_device_iter_get_next(iter, &next_onewire_device);
-    if (search_result == ESP_OK) {
+    while (found_count < MAX_PROBES &&
+           onewire_device_iter_get_next(iter, &next_onewire_device) == ESP_OK) {
         ds18b20_config_t ds_cfg = {};
-        if (ds18b20_new_device(&next_onewire_device, &ds_cfg, &thermometer_device) == ESP_OK) {
+        if (ds18b20_new_device(&next_onewire_device, &ds_cfg, &found_devices[found_count]) ==
+            ESP_OK) {
             ESP_LOGI(TAG,
                      "Found a DS18B20, address: %016llX",
                      (unsigned long long)next_onewire_device.address);
+            found_addresses[found_count++] = next_onewire_device.address;
         } else {
             ESP_LOGI(TAG,
                      "Found an unknown device, address: %016llX",
@@ -46,18 +81,143 @@ void init_temperature_sensor(int p_pin) {
 
     ESP_ERROR_CHECK(onewire_del_device_iter(iter));
 
-    ESP_ERROR_CHECK(ds18b20_set_resolution(thermometer_device, DS18B20_RESOLUTION_12B));
+    // zones with an address take their probe first, the rest take the remaining ones in order
+    for (int pass = 0; pass < 2; pass++) {
+        for (int zone = 0; zone < probes_count; zone++) {
+            uint64_t address = p_zones[zone].probe_address;
+            if ((pass == 0) != (address != 0)) {
+                continue;
+            }
+
+            for (int i = 0; i < found_count; i++) {
+                if (!claimed[i] && (address == 0 || found_addresses[i] == address)) {
+                    claimed[i] = true;
+                    probes[zone].device = found_devices[i];
+                    ESP_LOGI(TAG,
+                             "zone %d uses %016llX",
+                             zone,
+                             (unsigned long long)found_addresses[i]);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < found_count; i++) {
+        if (!claimed[i]) {
+            ds18b20_del_device(found_devices[i]);
+        }
+    }
+
+    // a missing probe is left to the safety supervisor instead of rebooting in a loop
+    for (int zone = 0; zone < probes_count; zone++) {
+        if (probes[zone].device == NULL) {
+            ESP_LOGE(TAG, "no DS18B20 found for zone %d", zone);
+            continue;
+        }
 
-    ESP_ERROR_CHECK(ds18b20_trigger_temperature_conversion(thermometer_device));
-    ESP_ERROR_CHECK(ds18b20_get_temperature(thermometer_device, &current_temperature));
+        esp_err_t ret = ds18b20_set_resolution(probes[zone].device, DS18B20_RESOLUTION_12B);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "ds18b20_set_resolution failed with %s", esp_err_to_name(ret));
+        }
+    }
 }
 
+// the periodic control task, every zone is read and handed to p_cb in the same iteration
 void temperature_read_loop(temperature_read_cb_t p_cb) {
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t last_start_us = 0;
     while (true) {
-        ESP_ERROR_CHECK(ds18b20_trigger_temperature_conversion(thermometer_device));
-        ESP_ERROR_CHECK(ds18b20_get_temperature(thermometer_device, &current_temperature));
-        p_cb(current_temperature);
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
 
-        vTaskDelay(1);
+        int64_t start_us = esp_timer_get_time();
+
+        esp_err_t ret = trigger_conversion();
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "trigger conversion failed with %s", esp_err_to_name(ret));
+        }
+
+        int64_t wait_start_us = esp_timer_get_time();
+        // the first tick of a delay can be partial
+        vTaskDelay(pdMS_TO_TICKS(CONVERSION_MS) + 1);
+        int64_t wait_us = esp_timer_get_time() - wait_start_us;
+
+        bool updated[MAX_ZONES] = {0};
+        for (int zone = 0; zone < probes_count; zone++) {
+            float temperature;
+            ret = ESP_FAIL;
+            for (int attempt = 1; attempt <= READ_ATTEMPTS; attempt++) {
+                ret = read_temperature(zone, &temperature);
+                if (ret == ESP_OK) {
+                    break;
+                }
+
+                ESP_LOGW(TAG,
+                         "zone %d read attempt %d failed with %s",
+                         zone,
+                         attempt,
+                         esp_err_to_name(ret));
+                vTaskDelay(pdMS_TO_TICKS(READ_RETRY_DELAY_MS));
+            }
+
+            // no update on failure, the safety supervisor sees the reading go stale
+            if (ret == ESP_OK) {
+                current_temperature[zone] = temperature;
+                updated[zone] = true;
+            } else {
+                ESP_LOGE(TAG, "zone %d giving up after %d attempts", zone, READ_ATTEMPTS);
+            }
+        }
+
+        p_cb(updated);
+
+        int64_t end_us = esp_timer_get_time();
+        temperature_loop_stats_t *stats = &temperature_loop_stats;
+        if (last_start_us != 0) {
+            stats->period_us = start_us - last_start_us;
+            stats->max_period_us = MAX(stats->max_period_us, stats->period_us);
+        }
+        stats->work_us = end_us - start_us - wait_us;
+        stats->max_work_us = MAX(stats->max_work_us, stats->work_us);
+        stats->total_work_us += stats->work_us;
+        stats->iterations++;
+        last_start_us = start_us;
     }
 }
+
+void temperature_inject_fault(int p_zone, temperature_fault_t p_fault, float p_value) {
+    probes[p_zone].injected_value = p_value;
+    probes[p_zone].injected_fault = p_fault;
+    temperature_fault_injected_tick[p_zone] =
+        p_fault == TEMPERATURE_FAULT_NONE ? 0 : xTaskGetTickCount();
+
+    ESP_LOGW(TAG, "zone %d injected fault %d, value %f", p_zone, p_fault, p_value);
+}
+
+// starts a conversion on every probe of the bus at once
+static esp_err_t trigger_conversion() {
+    esp_err_t ret = onewire_bus_reset(bus);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    const uint8_t command[] = {ONEWIRE_CMD_SKIP_ROM, DS18B20_CMD_CONVERT_TEMP};
+    return onewire_bus_write_bytes(bus, command, sizeof(command));
+}
+
+static esp_err_t read_temperature(int p_zone, float *p_temperature) {
+    switch (probes[p_zone].injected_fault) {
+    case TEMPERATURE_FAULT_READ_ERROR:
+        return ESP_ERR_INVALID_CRC;
+    case TEMPERATURE_FAULT_STUCK:
+        *p_temperature = current_temperature[p_zone];
+        return ESP_OK;
+    case TEMPERATURE_FAULT_OVERRIDE:
+        *p_temperature = probes[p_zone].injected_value;
+        return ESP_OK;
+    default:
+        break;
+    }
+
+    return ds18b20_get_temperature(probes[p_zone].device, p_temperature);
+}
@@ -1,9 +1,33 @@
 #pragma once
+#include "zone.h"
+
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <stdbool.h>
+
+// called once per control period, p_updated[zone] is set for every zone with a new reading
+typedef void (*temperature_read_cb_t)(const bool *p_updated);
+
+typedef enum {
+    TEMPERATURE_FAULT_NONE,
+    TEMPERATURE_FAULT_READ_ERROR, // every read fails as if the bus returned a bad CRC
+    TEMPERATURE_FAULT_STUCK,      // reads keep returning the last good value
+    TEMPERATURE_FAULT_OVERRIDE,   // reads return the injected value
+} temperature_fault_t;
 
-typedef void (*temperature_read_cb_t)(float p_temperature);
+struct {
+    uint32_t iterations;
+    uint32_t period_us;     // start to start of the last two iterations
+    uint32_t max_period_us;
+    uint32_t work_us;       // last iteration without the conversion wait
+    uint32_t max_work_us;
+    uint64_t total_work_us;
+} typedef temperature_loop_stats_t;
 
-extern float current_temperature;
+extern float current_temperature[MAX_ZONES];
+extern TickType_t temperature_fault_injected_tick[MAX_ZONES];
+extern temperature_loop_stats_t temperature_loop_stats;
 
-void init_temperature_sensor(int p_pin);
+void init_temperature_sensors(int p_pin, const zone_config_t *p_zones, int p_count);
 void temperature_read_loop(temperature_read_cb_t p_cb);
+void temperature_inject_fault(int p_zone, temperature_fault_t p_fault, float p_value);
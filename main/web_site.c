@@ -1,5 +1,7 @@
 #include "web_site.h"
 #include "heater.h"
+#include "safety.h"
+#include "temperature.h"
 
 #include <esp_spiffs.h>
 #include <esp_log.h>
@@ -8,9 +10,19 @@
 #include <freertos/FreeRTOS.h>
 #include <sys/stat.h>
 #include <cJSON.h>
+#include <stdarg.h>
 
 #define TAG "web site"
 
+// fields of every entry in a { "zones":[...]} frame
+#define ZONE_FIELD_TEMPERATURE (1 << 0)
+#define ZONE_FIELD_STATE (1 << 1) // caller holds configuration_mutex
+#define ZONE_FIELD_FAULT (1 << 2)
+
+// longest entry is a zone with every field
+#define MAX_ZONE_ENTRY_LEN 160
+#define MAX_PREFIX_LEN 96
+
 static char *s_index_html;
 static char *s_styles_css;
 static char *s_layout_css;
@@ -26,17 +38,39 @@ struct {
                        {"/spiffs/main.js", &s_main_js}};
 
 static httpd_handle_t s_server = NULL;
+static state_change_cb_t s_state_change_cb = NULL;
 
 static esp_err_t get_req_handler(httpd_req_t *p_req);
 static esp_err_t ws_req_handler(httpd_req_t *p_req);
 
-static esp_err_t on_message(httpd_ws_frame_t p_frame);
+static esp_err_t on_message(int p_sender, httpd_ws_frame_t p_frame);
+
+// the ops of one command for one zone
+struct {
+    bool has_target_temperature;
+    float target_temperature;
+    bool has_heater_state;
+    bool heater_state;
+#if SAFETY_FAULT_INJECTION
+    bool has_injected_fault;
+    temperature_fault_t injected_fault;
+    float injected_value;
+#endif
+} typedef command_t;
+
+static const char *parse_op(const cJSON *p_op, command_t *p_commands);
+static char *format_response(const char *p_seq, const char *p_error);
+static bool is_integer(const cJSON *p_json);
+static char *format_zones(const char *p_prefix, const bool *p_zones, int p_fields);
+static void append(char *p_text, int p_size, int *p_len, const char *p_format, ...)
+    __attribute__((format(printf, 4, 5)));
 
 struct {
     char *text;
     int target;
 } typedef ws_message_t;
 
+static esp_err_t queue_message(char *p_text, int p_target);
 static void ws_async_send(ws_message_t *p_message);
 
 void load_web_pages() {
@@ -102,44 +136,41 @@ httpd_handle_t setup_web_server() {
     return s_server;
 }
 
-esp_err_t send_temperature_update(float p_temperature, int p_target) {
-    const char *const fmt_str = "{ \"current_temperature\":%f}";
-
-    ws_message_t *message = malloc(sizeof(ws_message_t));
-    message->target = FD_EVERYONE;
-
-    int req_size = snprintf(NULL, 0, fmt_str, p_temperature);
-    message->text = malloc(req_size + 1);
-    snprintf(message->text, req_size + 1, fmt_str, p_temperature);
+// one frame for every zone read in a control period
+esp_err_t send_temperature_update(const bool *p_zones, int p_target) {
+    bool any_zone = p_zones == NULL;
+    for (int zone = 0; p_zones && zone < zones_count; zone++) {
+        any_zone |= p_zones[zone];
+    }
+    if (!any_zone) {
+        return ESP_OK;
+    }
 
-    return httpd_queue_work(s_server, (httpd_work_fn_t)ws_async_send, message);
+    return queue_message(format_zones("", p_zones, ZONE_FIELD_TEMPERATURE), p_target);
 }
 
-esp_err_t send_target_temperature_update(int p_target) {
-    const char *const fmt_str = "{ \"target_temperature\":%f}";
-
-    ws_message_t *message = malloc(sizeof(ws_message_t));
-    message->target = FD_EVERYONE;
-
-    int req_size = snprintf(NULL, 0, fmt_str, target_temperature);
-    message->text = malloc(req_size + 1);
-    snprintf(message->text, req_size + 1, fmt_str, target_temperature);
+// caller holds configuration_mutex
+esp_err_t send_state_update(const bool *p_zones, int p_target) {
+    if (p_target == FD_EVERYONE && s_state_change_cb) {
+        s_state_change_cb();
+    }
 
-    return httpd_queue_work(s_server, (httpd_work_fn_t)ws_async_send, message);
+    return queue_message(format_zones("", p_zones, ZONE_FIELD_STATE), p_target);
 }
 
-esp_err_t send_heater_state_update(int p_target) {
-    const char *const fmt_str = "{ \"heater_state\":%s}";
+esp_err_t send_fault_update(int p_zone, int p_target) {
+    if (p_target == FD_EVERYONE && s_state_change_cb) {
+        s_state_change_cb();
+    }
 
-    ws_message_t *message = malloc(sizeof(ws_message_t));
-    message->target = FD_EVERYONE;
+    bool zones[MAX_ZONES] = {0};
+    zones[p_zone] = true;
 
-    const char *const state_str = heater_state ? "true" : "false";
-    int req_size = snprintf(NULL, 0, fmt_str, state_str);
-    message->text = malloc(req_size + 1);
-    snprintf(message->text, req_size + 1, fmt_str, state_str);
+    return queue_message(format_zones("", zones, ZONE_FIELD_FAULT), p_target);
+}
 
-    return httpd_queue_work(s_server, (httpd_work_fn_t)ws_async_send, message);
+void set_state_change_cb(state_change_cb_t p_cb) {
+    s_state_change_cb = p_cb;
 }
 
 static esp_err_t get_req_handler(httpd_req_t *p_req) {
@@ -184,9 +215,10 @@ static esp_err_t ws_req_handler(httpd_req_t *p_req) {
             ESP_LOGE(TAG, "failed to take target_temperature_mutex");
             esp_restart();
         }
-        send_target_temperature_update(httpd_req_to_sockfd(p_req));
-        send_heater_state_update(httpd_req_to_sockfd(p_req));
+        char *text = format_zones("", NULL, ZONE_FIELD_STATE | ZONE_FIELD_FAULT);
         xSemaphoreGive(configuration_mutex);
+
+        queue_message(text, httpd_req_to_sockfd(p_req));
         return ESP_OK;
     }
 
@@ -217,46 +249,299 @@ static esp_err_t ws_req_handler(httpd_req_t *p_req) {
         return ret;
     }
 
-    return on_message(frame);
+    return on_message(httpd_req_to_sockfd(p_req), frame);
 }
 
-static esp_err_t on_message(httpd_ws_frame_t p_frame) {
-    cJSON *root = cJSON_Parse((const char *)p_frame.payload);
+static esp_err_t on_message(int p_sender, httpd_ws_frame_t p_frame) {
+    char *response = NULL;
+    apply_command((const char *)p_frame.payload, &response);
+    free(p_frame.payload);
+
+    return queue_message(response, p_sender);
+}
+
+// {"seq": 1, "ops": [{"zone": 0, "target_temperature": 60}, {"zone": 1, "heater_state": true}]}
+// every op is validated before any is applied, a bare op without an envelope is accepted too
+esp_err_t apply_command(const char *p_text, char **p_response) {
+    command_t commands[MAX_ZONES] = {0};
+    const char *error = NULL;
+
+    cJSON *root = cJSON_Parse(p_text);
+    cJSON *seq_json = root ? cJSON_GetObjectItem(root, "seq") : NULL;
     if (!root) {
-        ESP_LOGE(TAG, "invalid json received");
-        return -1;
+        error = "invalid json";
+    } else if (seq_json && !is_integer(seq_json)) {
+        // echoing a rounded or saturated seq would ack some other command
+        error = "seq is not an integer";
+        seq_json = NULL;
+    } else {
+        cJSON *ops_json = cJSON_GetObjectItem(root, "ops");
+        if (!ops_json) {
+            error = parse_op(root, commands);
+        } else if (!cJSON_IsArray(ops_json)) {
+            error = "ops is not an array";
+        } else {
+            cJSON *op_json;
+            cJSON_ArrayForEach(op_json, ops_json) {
+                error = parse_op(op_json, commands);
+                if (error) {
+                    break;
+                }
+            }
+        }
     }
 
+    char seq_str[16] = "null";
+    if (seq_json) {
+        snprintf(seq_str, sizeof(seq_str), "%d", seq_json->valueint);
+    }
+
+    cJSON_Delete(root);
+
     if (xSemaphoreTake(configuration_mutex, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "failed to take target_temperature_mutex");
         esp_restart();
     }
 
-    cJSON *target_temperature_json = cJSON_GetObjectItem(root, "target_temperature");
-    if (target_temperature_json && target_temperature_json->type == cJSON_Number) {
-        target_temperature = target_temperature_json->valuedouble;
-        ESP_LOGI(TAG, "new target temperature %f", target_temperature);
-        send_target_temperature_update(FD_EVERYONE);
-    }
+    bool changed[MAX_ZONES] = {0};
+    bool switched_on[MAX_ZONES] = {0};
+    bool any_changed = false;
+    if (!error) {
+        for (int zone = 0; zone < zones_count; zone++) {
+            const command_t *command = &commands[zone];
+            heater_t *heater = &heaters[zone];
+
+            if (command->has_target_temperature &&
+                command->target_temperature != heater->target_temperature) {
+                heater->target_temperature = command->target_temperature;
+                ESP_LOGI(TAG,
+                         "zone %d new target temperature %f",
+                         zone,
+                         heater->target_temperature);
+                changed[zone] = true;
+            }
 
-    cJSON *heater_state_json = cJSON_GetObjectItem(root, "heater_state");
-    if (heater_state_json &&
-        (heater_state_json->type == cJSON_True || heater_state_json->type == cJSON_False)) {
-        heater_state = heater_state_json->type == cJSON_True;
-        ESP_LOGI(TAG, "is on updated to: %s", heater_state ? "ON" : "OFF");
-        send_heater_state_update(FD_EVERYONE);
+            if (command->has_heater_state && command->heater_state != heater->heater_state) {
+                heater->heater_state = command->heater_state;
+                switched_on[zone] = heater->heater_state;
+                ESP_LOGI(TAG,
+                         "zone %d is on updated to: %s",
+                         zone,
+                         heater->heater_state ? "ON" : "OFF");
+                changed[zone] = true;
+            }
+
+            any_changed |= changed[zone];
+        }
+
+        // one frame for all zones the command changed
+        if (any_changed) {
+            send_state_update(changed, FD_EVERYONE);
+        }
+
+        for (int zone = 0; zone < zones_count; zone++) {
+            if (changed[zone]) {
+                save_heater_configuration_to_nvs(zone);
+            }
+        }
+    } else {
+        ESP_LOGE(TAG, "command %s rejected: %s", seq_str, error);
     }
 
-    save_heater_configuration_to_nvs();
+    // the response carries the resulting state so the sender never has to guess
+    *p_response = format_response(seq_str, error);
 
     xSemaphoreGive(configuration_mutex);
 
-    cJSON_Delete(root);
+    if (error) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int zone = 0; zone < zones_count; zone++) {
+        // switching the heater from off to on is how the user acknowledges a safety fault,
+        // a trip switches it off, so repeating "on" does not re-arm the zone
+        if (switched_on[zone]) {
+            safety_clear_fault(zone);
+        }
+
+#if SAFETY_FAULT_INJECTION
+        const command_t *command = &commands[zone];
+        if (command->has_injected_fault) {
+            temperature_inject_fault(zone, command->injected_fault, command->injected_value);
+        }
+#endif
+    }
 
-    free(p_frame.payload);
     return ESP_OK;
 }
 
+// caller holds configuration_mutex
+static char *format_response(const char *p_seq, const char *p_error) {
+    char prefix[MAX_PREFIX_LEN];
+    if (!p_error) {
+        snprintf(prefix, sizeof(prefix), "\"ack\":%s, ", p_seq);
+    } else {
+        snprintf(prefix, sizeof(prefix), "\"nack\":%s, \"error\":\"%s\", ", p_seq, p_error);
+    }
+
+    // the state of every zone, not only the ones the command addressed
+    return format_zones(prefix, NULL, ZONE_FIELD_STATE);
+}
+
+static char *format_zones(const char *p_prefix, const bool *p_zones, int p_fields) {
+    char text[MAX_PREFIX_LEN + MAX_ZONES * MAX_ZONE_ENTRY_LEN];
+    int len = 0;
+    append(text, sizeof(text), &len, "{ %s\"zones\":[", p_prefix);
+
+    bool first = true;
+    for (int zone = 0; zone < zones_count; zone++) {
+        if (p_zones && !p_zones[zone]) {
+            continue;
+        }
+
+        append(text, sizeof(text), &len, "%s{\"zone\":%d", first ? "" : ",", zone);
+        first = false;
+
+        if (p_fields & ZONE_FIELD_TEMPERATURE) {
+            append(text,
+                   sizeof(text),
+                   &len,
+                   ",\"current_temperature\":%f",
+                   current_temperature[zone]);
+        }
+        if (p_fields & ZONE_FIELD_STATE) {
+            append(text,
+                   sizeof(text),
+                   &len,
+                   ",\"target_temperature\":%f,\"heater_state\":%s",
+                   heaters[zone].target_temperature,
+                   heaters[zone].heater_state ? "true" : "false");
+        }
+        if (p_fields & ZONE_FIELD_FAULT) {
+            append(text,
+                   sizeof(text),
+                   &len,
+                   ",\"fault\":\"%s\"",
+                   safety_fault_to_name(safety_fault[zone]));
+        }
+
+        append(text, sizeof(text), &len, "}");
+    }
+
+    append(text, sizeof(text), &len, "]}");
+
+    // a cut off frame is not valid json, drop it instead
+    if (len >= sizeof(text)) {
+        ESP_LOGE(TAG, "zones do not fit in %d bytes", (int)sizeof(text));
+        return NULL;
+    }
+
+    char *result = malloc(len + 1);
+    memcpy(result, text, len + 1);
+    return result;
+}
+
+// snprintf at *p_len, does nothing once p_text is full so p_size - *p_len never wraps
+static void append(char *p_text, int p_size, int *p_len, const char *p_format, ...) {
+    if (*p_len >= p_size) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, p_format);
+    *p_len += vsnprintf(p_text + *p_len, p_size - *p_len, p_format, args);
+    va_end(args);
+}
+
+static const char *parse_op(const cJSON *p_op, command_t *p_commands) {
+    if (!cJSON_IsObject(p_op)) {
+        return "op is not an object";
+    }
+
+    // ops without a zone address zone 0, as sent by single zone clients
+    int zone = 0;
+    const cJSON *zone_json = cJSON_GetObjectItem(p_op, "zone");
+    if (zone_json) {
+        if (!is_integer(zone_json)) {
+            return "zone is not an integer";
+        }
+        if (zone_json->valueint < 0 || zone_json->valueint >= zones_count) {
+            return "unknown zone";
+        }
+        zone = zone_json->valueint;
+    }
+    command_t *command = &p_commands[zone];
+
+    const cJSON *field;
+    cJSON_ArrayForEach(field, p_op) {
+        if (!strcmp(field->string, "seq") || !strcmp(field->string, "ops") ||
+            !strcmp(field->string, "zone")) {
+            continue;
+        } else if (!strcmp(field->string, "target_temperature")) {
+            if (!cJSON_IsNumber(field)) {
+                return "target_temperature is not a number";
+            }
+            if (field->valuedouble < MIN_TARGET_TEMPERATURE ||
+                field->valuedouble > MAX_TARGET_TEMPERATURE) {
+                return "target_temperature out of range";
+            }
+            command->has_target_temperature = true;
+            command->target_temperature = field->valuedouble;
+        } else if (!strcmp(field->string, "heater_state")) {
+            if (!cJSON_IsBool(field)) {
+                return "heater_state is not a bool";
+            }
+            command->has_heater_state = true;
+            command->heater_state = cJSON_IsTrue(field);
+#if SAFETY_FAULT_INJECTION
+        } else if (!strcmp(field->string, "inject_fault")) {
+            if (!cJSON_IsString(field)) {
+                return "inject_fault is not a string";
+            }
+            command->has_injected_fault = true;
+            if (!strcmp(field->valuestring, "read_error")) {
+                command->injected_fault = TEMPERATURE_FAULT_READ_ERROR;
+            } else if (!strcmp(field->valuestring, "stuck")) {
+                command->injected_fault = TEMPERATURE_FAULT_STUCK;
+            } else if (!strcmp(field->valuestring, "override")) {
+                command->injected_fault = TEMPERATURE_FAULT_OVERRIDE;
+            } else {
+                command->injected_fault = TEMPERATURE_FAULT_NONE;
+            }
+        } else if (!strcmp(field->string, "value")) {
+            if (!cJSON_IsNumber(field)) {
+                return "value is not a number";
+            }
+            command->injected_value = field->valuedouble;
+#endif
+        } else {
+            return "unknown field";
+        }
+    }
+
+    return NULL;
+}
+
+// takes ownership of p_text
+static esp_err_t queue_message(char *p_text, int p_target) {
+    if (p_text == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ws_message_t *message = malloc(sizeof(ws_message_t));
+    message->target = p_target;
+    message->text = p_text;
+
+    // the safety task broadcasts before the server may be up
+    esp_err_t ret = httpd_queue_work(s_server, (httpd_work_fn_t)ws_async_send, message);
+    if (ret != ESP_OK) {
+        free(message->text);
+        free(message);
+    }
+
+    return ret;
+}
+
 // httpd_queue_work(s_server, ws_async_send, p_message);
 
 static void ws_async_send(ws_message_t *p_message) {
@@ -288,3 +573,8 @@ static void ws_async_send(ws_message_t *p_message) {
     free(p_message->text);
     free(p_message);
 }
+
+// cJSON saturates valueint, so out of range numbers fail the comparison as well
+static bool is_integer(const cJSON *p_json) {
+    return cJSON_IsNumber(p_json) && p_json->valuedouble == p_json->valueint;
+}
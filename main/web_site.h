@@ -1,10 +1,17 @@
 #pragma once
 #include <esp_http_server.h>
+#include <stdbool.h>
 
 #define FD_EVERYONE -1
 
+// called whenever a state or fault change is broadcast, e.g. to republish it elsewhere
+typedef void (*state_change_cb_t)();
+
 void load_web_pages();
 httpd_handle_t setup_web_server();
-esp_err_t send_temperature_update(float p_temperature, int p_target);
-esp_err_t send_target_temperature_update(int p_target);
-esp_err_t send_heater_state_update(int p_target);
+// p_zones selects the zones in the frame, NULL sends every zone
+esp_err_t send_temperature_update(const bool *p_zones, int p_target);
+esp_err_t send_state_update(const bool *p_zones, int p_target);
+esp_err_t send_fault_update(int p_zone, int p_target);
+esp_err_t apply_command(const char *p_text, char **p_response);
+void set_state_change_cb(state_change_cb_t p_cb);
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+
+// every zone is one bath with its own heater, probe, setpoint and controller
+// zone 0 heater is mirrored to the led, the others take the next ledc channels
+#define MAX_ZONES 4
+
+struct {
+    int heater_pin;
+    uint64_t probe_address; // 0 takes the first probe on the bus that no other zone claimed
+} typedef zone_config_t;
+
+// set once by init_heaters before any task is started
+extern int zones_count;